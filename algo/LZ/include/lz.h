@@ -12,21 +12,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 #include "../../common/common.h"
 
+// Size of a phrase buffer; phrases are at most MAX - 1 bytes long
 #define MAX 256
+// Initial size of the decoding table, which grows with the number of codes
 #define TABLE_SIZE 4096
 
 typedef struct TreeNode {
     char key[MAX];
-    int value;
+    uint64_t value;
     struct TreeNode *left;
     struct TreeNode *right;
 } TreeNode;
 
-TreeNode* lz_create_node(const char *key, int value);
-TreeNode* lz_insert_node(TreeNode *node, const char *key, int value);
+TreeNode* lz_create_node(const char *key, uint64_t value);
+TreeNode* lz_insert_node(TreeNode *node, const char *key, uint64_t value);
 TreeNode* lz_search_node(TreeNode *node, const char *key);
 void lz_free_tree(TreeNode *node);
 void lz_encoding(const char *input_filename, const char *output_filename);
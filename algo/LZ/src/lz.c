@@ -35,7 +35,7 @@
  * @param value The value associated with the key.
  * @return A pointer to the new node.
  */
-TreeNode* lz_create_node(const char *key, int value) {
+TreeNode* lz_create_node(const char *key, uint64_t value) {
     TreeNode *new_node = (TreeNode *)malloc(sizeof(TreeNode));
     strcpy(new_node->key, key);
     new_node->value = value;
@@ -51,7 +51,7 @@ TreeNode* lz_create_node(const char *key, int value) {
  * @param value The value associated with the key.
  * @return The root node of the modified tree.
  */
-TreeNode* lz_insert_node(TreeNode *node, const char *key, int value) {
+TreeNode* lz_insert_node(TreeNode *node, const char *key, uint64_t value) {
     if (node == NULL) return lz_create_node(key, value);
 
     int cmp = strcmp(key, node->key);
@@ -118,7 +118,7 @@ void lz_encoding(const char *input_filename, const char *output_filename) {
     }
 
     char p[MAX] = "", c[2] = "";
-    int code = 256;
+    uint64_t code = 256;
     DEBUG_PRINT("String\tOutput_Code\tAddition\n");
 
     int ch;
@@ -130,13 +130,14 @@ void lz_encoding(const char *input_filename, const char *output_filename) {
         strcpy(pc, p);
         strcat(pc, c);
 
-        if (lz_search_node(root, pc) != NULL) {
+        // A phrase stops growing when it fills its buffer
+        if (strlen(pc) < MAX - 1 && lz_search_node(root, pc) != NULL) {
             strcpy(p, pc);
         } else {
             TreeNode *node = lz_search_node(root, p);
             if (node) {
-                DEBUG_PRINT("%s\t%d\t\t%s\t%d\n", p, node->value, pc, code);
-                fprintf(output_file, "%d ", node->value);
+                DEBUG_PRINT("%s\t%" PRIu64 "\t\t%s\t%" PRIu64 "\n", p, node->value, pc, code);
+                fprintf(output_file, "%" PRIu64 " ", node->value);
                 root = lz_insert_node(root, pc, code);
                 code++;
             } else {
@@ -148,8 +149,8 @@ void lz_encoding(const char *input_filename, const char *output_filename) {
 
     TreeNode *node = lz_search_node(root, p);
     if (node) {
-        DEBUG_PRINT("%s\t%d\n", p, node->value);
-        fprintf(output_file, "%d\n", node->value);
+        DEBUG_PRINT("%s\t%" PRIu64 "\n", p, node->value);
+        fprintf(output_file, "%" PRIu64 "\n", node->value);
     }
 
     fclose(input_file);
@@ -175,39 +176,49 @@ void lz_decoding(const char *input_filename, const char *output_filename) {
         return;
     }
 
-    char *table[TABLE_SIZE];
-    for (int i = 0; i < TABLE_SIZE; i++) {
-        table[i] = (char *)malloc(MAX * sizeof(char));
-        if (i < 256) {
-            table[i][0] = (char)i;
-            table[i][1] = '\0';
-        } else {
-            table[i][0] = '\0';
-        }
+    uint64_t old, n;
+    if (fscanf(input_file, "%" SCNu64, &old) != 1 || old > 255) {
+        fprintf(stderr, "Error reading the first integer from file.\n");
+        fclose(input_file);
+        fclose(output_file);
+        return;
     }
+    DEBUG_PRINT("First code: %" PRIu64 "\n", old);
 
-    int old, n;
-    if (fscanf(input_file, "%d", &old) != 1) {
-        fprintf(stderr, "Error reading the first integer from file.\n");
+    // Entries are allocated to their length, the table doubles when full
+    size_t capacity = TABLE_SIZE;
+    char **table = (char **)malloc(capacity * sizeof(char *));
+    if (table == NULL) {
+        perror("Error allocating the table");
         fclose(input_file);
         fclose(output_file);
         return;
     }
-    DEBUG_PRINT("First code: %d\n", old);
+    for (int i = 0; i < 256; i++) {
+        table[i] = (char *)malloc(2 * sizeof(char));
+        table[i][0] = (char)i;
+        table[i][1] = '\0';
+    }
 
     fprintf(output_file, "%s", table[old]);
     DEBUG_PRINT("Decoded first string: %s\n", table[old]);
 
-    int count = 256;
+    uint64_t count = 256;
     char s[MAX], c[2];
     strcpy(s, table[old]);
     c[0] = s[0];
     c[1] = '\0';
 
-    while (fscanf(input_file, "%d", &n) != EOF) {
-        DEBUG_PRINT("Read code: %d\n", n);
-        if (n >= count) {
-            DEBUG_PRINT("Code %d not found in table. Handling special case.\n", n);
+    while (fscanf(input_file, "%" SCNu64, &n) == 1) {
+        DEBUG_PRINT("Read code: %" PRIu64 "\n", n);
+        // The encoder never makes a phrase longer than MAX - 1 bytes
+        size_t len = strlen(table[old]);
+        if (n > count || len + 1 >= MAX) {
+            fprintf(stderr, "Error: invalid code %" PRIu64 ".\n", n);
+            break;
+        }
+        if (n == count) {
+            DEBUG_PRINT("Code %" PRIu64 " not found in table. Handling special case.\n", n);
             strcpy(s, table[old]);
             strcat(s, c);
         } else {
@@ -217,16 +228,28 @@ void lz_decoding(const char *input_filename, const char *output_filename) {
         fprintf(output_file, "%s", s);
         c[0] = s[0];
         c[1] = '\0';
+
+        if (count == capacity) {
+            char **bigger = (char **)realloc(table, 2 * capacity * sizeof(char *));
+            if (bigger == NULL) {
+                perror("Error allocating the table");
+                break;
+            }
+            table = bigger;
+            capacity *= 2;
+        }
+        table[count] = (char *)malloc(len + 2);
         strcpy(table[count], table[old]);
         strcat(table[count], c);
-        DEBUG_PRINT("Inserting new entry: %s with code %d\n", table[count], count);
+        DEBUG_PRINT("Inserting new entry: %s with code %" PRIu64 "\n", table[count], count);
         count++;
         old = n;
     }
 
-    for (int i = 0; i < TABLE_SIZE; i++) {
+    for (uint64_t i = 0; i < count; i++) {
         free(table[i]);
     }
+    free(table);
 
     fclose(input_file);
     fclose(output_file);
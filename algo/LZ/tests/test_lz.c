@@ -169,6 +169,49 @@ void test_decoding() {
     remove(output_filename);
 }
 
+/**
+ * @brief Test a round trip on a large input.
+ * A long run makes phrases reach MAX - 1 bytes and the text afterwards needs
+ * far more than TABLE_SIZE codes.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_round_trip() {
+    const char *input_filename = "test_input.txt";
+    const char *encoded_filename = "test_input.txt_LZenc";
+    const char *decoded_filename = "test_input.txt_LZdec";
+
+    FILE *input_file = fopen(input_filename, "w");
+    for (int i = 0; i < 40000; i++) {
+        fputc('a', input_file);
+    }
+    unsigned int seed = 5;
+    for (int i = 0; i < 20000; i++) {
+        seed = seed * 1103515245 + 12345;
+        fputc('a' + (seed >> 16) % 26, input_file);
+    }
+    fclose(input_file);
+
+    lz_encoding(input_filename, encoded_filename);
+    lz_decoding(encoded_filename, decoded_filename);
+
+    input_file = fopen(input_filename, "r");
+    FILE *decoded_file = fopen(decoded_filename, "r");
+    assert(input_file != NULL && decoded_file != NULL);
+    int ch1, ch2;
+    do {
+        ch1 = fgetc(input_file);
+        ch2 = fgetc(decoded_file);
+        assert(ch1 == ch2);
+    } while (ch1 != EOF);
+
+    fclose(input_file);
+    fclose(decoded_file);
+    remove(input_filename);
+    remove(encoded_filename);
+    remove(decoded_filename);
+}
+
 /**
  * @brief Main function for the test_lz program.
 */
@@ -178,6 +221,7 @@ int main() {
     test_search_node();
     test_encoding();
     test_decoding();
+    test_round_trip();
 
     printf("All tests passed successfully.\n");
     return 0;
@@ -0,0 +1,247 @@
+/**
+ * @file bench_binio.c
+ * @author bgrolleau001 llunet001
+ * @brief Throughput benchmark of the binary stream I/O functions.
+ * Every combination of operation, chunk width, alignment, padding and backend
+ * is timed and reported as a CSV line on the standard output.
+ * @version 0.1
+ * @date 2024-05-28
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+/*
+ * Copyright 2024 Benjamin Grolleau et Louis Lunet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "../include/binio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "bench_binio.bin"
+#define BENCH_DEFAULT_MBYTES 4
+// Offset in bits of the payload in an unaligned stream
+#define BENCH_SHIFT 3
+
+enum bench_op { OP_BPUTBIT, OP_BPUTBITS, OP_BWRITE, OP_BGETBIT, OP_BPEEK, OP_BREAD };
+
+static const char *op_names[] = {"bputbit", "bputbits", "bwrite", "bgetbit", "bpeek_bskip", "bread"};
+static const char *backend_names[] = {"file", "mmap", "mem"};
+static const unsigned int widths[] = {1, 7, 8, 13, 32, 64};
+
+// Keeps the compiler from dropping the reads
+static volatile uint64_t sink;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t load64(const uchar *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Writes nbits bits of payload in chunks of width bits.
+ * @return The elapsed time in seconds, bclose() included.
+ */
+static double bench_write(enum bench_op op, unsigned int width, int unaligned, int padding, int backend,
+                          const uchar *payload, uint64_t nbits) {
+    uchar *buf = NULL;
+    size_t size = 0;
+    BFILE *bfile = (backend == BINIO_BACKEND_MEM) ? bopen_membuf(&buf, &size, padding)
+                                                  : bopen(BENCH_FILE, 'w', padding);
+    if (bfile == NULL) {
+        perror("bench_write");
+        exit(1);
+    }
+    if (unaligned) {
+        bputbits(0, BENCH_SHIFT, bfile);
+    }
+
+    double start = now();
+    switch (op) {
+    case OP_BPUTBIT:
+        for (uint64_t i = 0; i < nbits; i++) {
+            bputbit((payload[i >> 3] >> (i & 7)) & 1, bfile);
+        }
+        break;
+    case OP_BPUTBITS:
+        for (uint64_t pos = 0; pos < nbits; pos += width) {
+            bputbits(load64(payload + (pos >> 3)), width, bfile);
+        }
+        break;
+    default:
+        for (uint64_t pos = 0; pos < nbits; pos += width) {
+            bwrite((void *)(payload + (pos >> 3)), width, bfile);
+        }
+        break;
+    }
+    bclose(bfile);
+    double elapsed = now() - start;
+
+    free(buf);
+    return elapsed;
+}
+
+/**
+ * @brief Reads nbits bits in chunks of width bits from the stream held by buf.
+ * @return The elapsed time in seconds, bclose() included.
+ */
+static double bench_read(enum bench_op op, unsigned int width, int unaligned, int padding, int backend,
+                         const uchar *buf, size_t size, uint64_t nbits) {
+    BFILE *bfile;
+    if (backend == BINIO_BACKEND_MEM) {
+        bfile = bopen_mem(buf, size, padding);
+    } else {
+        bfile = bopen(BENCH_FILE, backend == BINIO_BACKEND_MMAP ? 'm' : 'r', padding);
+    }
+    if (bfile == NULL) {
+        perror("bench_read");
+        exit(1);
+    }
+    if (unaligned) {
+        bskip(bfile, BENCH_SHIFT);
+    }
+
+    uint64_t sum = 0;
+    uchar chunk[8];
+    double start = now();
+    switch (op) {
+    case OP_BGETBIT:
+        for (uint64_t i = 0; i < nbits; i++) {
+            sum += bgetbit(bfile);
+        }
+        break;
+    case OP_BPEEK:
+        for (uint64_t pos = 0; pos < nbits; pos += width) {
+            sum += bpeek(bfile, width);
+            bskip(bfile, width);
+        }
+        break;
+    default:
+        for (uint64_t pos = 0; pos < nbits; pos += width) {
+            bread(chunk, width, bfile);
+            sum += chunk[0];
+        }
+        break;
+    }
+    bclose(bfile);
+    double elapsed = now() - start;
+
+    sink += sum;
+    return elapsed;
+}
+
+/**
+ * @brief Builds the stream read by bench_read(): the payload, shifted or not,
+ * followed by the padding pattern if needed. It is also saved to BENCH_FILE.
+ */
+static void bench_input(int unaligned, int padding, const uchar *payload, uint64_t nbits,
+                        uchar **buf, size_t *size) {
+    BFILE *bfile = bopen_membuf(buf, size, padding);
+    if (unaligned) {
+        bputbits(0, BENCH_SHIFT, bfile);
+    }
+    bwrite((void *)payload, nbits, bfile);
+    bclose(bfile);
+
+    FILE *f = fopen(BENCH_FILE, "wb");
+    if (f == NULL || fwrite(*buf, 1, *size, f) != *size) {
+        perror("bench_input");
+        exit(1);
+    }
+    fclose(f);
+}
+
+static void report(enum bench_op op, unsigned int width, int unaligned, int padding, int backend,
+                   uint64_t nbits, double seconds) {
+    printf("%s,%u,%s,%d,%s,%llu,%.6f,%.1f\n", op_names[op], width, unaligned ? "unaligned" : "aligned",
+           padding, backend_names[backend], (unsigned long long)nbits, seconds, nbits / seconds / 1e6);
+    fflush(stdout);
+}
+
+/**
+ * @brief Usage: bench_binio [megabytes]. Each measure moves that many
+ * megabytes of payload (BENCH_DEFAULT_MBYTES by default).
+ */
+int main(int argc, char *argv[]) {
+    unsigned long mbytes = (argc > 1) ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_MBYTES;
+    if (mbytes == 0) {
+        fprintf(stderr, "Usage: %s [megabytes]\n", argv[0]);
+        return 1;
+    }
+
+    // The widths divide the payload evenly; 8 spare bytes for the word loads
+    uint64_t nbits = (uint64_t)mbytes * 1000 * 1000 * 8 / (7 * 13 * 64) * (7 * 13 * 64);
+    uchar *payload = malloc(nbits / 8 + 8);
+    if (payload == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    uint64_t seed = 1;
+    for (uint64_t i = 0; i < nbits / 8 + 8; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        payload[i] = seed >> 56;
+    }
+
+    printf("op,width,alignment,padding,backend,bits,seconds,mbit_per_s\n");
+    size_t nwidths = sizeof(widths) / sizeof(widths[0]);
+
+    for (int unaligned = 0; unaligned <= 1; unaligned++) {
+        for (int padding = 0; padding <= 1; padding++) {
+            int backends[] = {BINIO_BACKEND_FILE, BINIO_BACKEND_MEM};
+            for (int b = 0; b < 2; b++) {
+                report(OP_BPUTBIT, 1, unaligned, padding, backends[b], nbits,
+                       bench_write(OP_BPUTBIT, 1, unaligned, padding, backends[b], payload, nbits));
+                for (size_t w = 0; w < nwidths; w++) {
+                    report(OP_BPUTBITS, widths[w], unaligned, padding, backends[b], nbits,
+                           bench_write(OP_BPUTBITS, widths[w], unaligned, padding, backends[b], payload, nbits));
+                    report(OP_BWRITE, widths[w], unaligned, padding, backends[b], nbits,
+                           bench_write(OP_BWRITE, widths[w], unaligned, padding, backends[b], payload, nbits));
+                }
+            }
+
+            uchar *buf = NULL;
+            size_t size = 0;
+            bench_input(unaligned, padding, payload, nbits, &buf, &size);
+            for (int backend = BINIO_BACKEND_FILE; backend <= BINIO_BACKEND_MEM; backend++) {
+                report(OP_BGETBIT, 1, unaligned, padding, backend, nbits,
+                       bench_read(OP_BGETBIT, 1, unaligned, padding, backend, buf, size, nbits));
+                for (size_t w = 0; w < nwidths; w++) {
+                    // bpeek() shows at most BINIO_MAX_BITS bits
+                    if (widths[w] <= BINIO_MAX_BITS) {
+                        report(OP_BPEEK, widths[w], unaligned, padding, backend, nbits,
+                               bench_read(OP_BPEEK, widths[w], unaligned, padding, backend, buf, size, nbits));
+                    }
+                    report(OP_BREAD, widths[w], unaligned, padding, backend, nbits,
+                           bench_read(OP_BREAD, widths[w], unaligned, padding, backend, buf, size, nbits));
+                }
+            }
+            free(buf);
+        }
+    }
+
+    free(payload);
+    remove(BENCH_FILE);
+    return 0;
+}
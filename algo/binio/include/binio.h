@@ -15,9 +15,39 @@
     #include <stdio.h>
     #include <stdlib.h>
     #include <string.h>
+    #include <stdint.h>
 
     #include "../../common/common.h"
 
+    /**
+     * @brief Size in bytes of the block buffer of a binary stream.
+     * Whole blocks are read from or handed to the underlying file at once.
+    */
+    #define BINIO_BUFFER_SIZE 65536
+
+    /**
+     * @brief Initial size in bytes of the buffer of a memory-backed writing stream.
+    */
+    #define BINIO_MEM_MIN_SIZE 4096
+
+    /**
+     * @brief Kinds of storage a binary stream can be backed by.
+    */
+    #define BINIO_BACKEND_FILE 0
+    #define BINIO_BACKEND_MMAP 1
+    #define BINIO_BACKEND_MEM 2
+
+    /**
+     * @brief Maximal number of bits accepted by a single bputbits() call.
+     * The accumulator is 64 bits wide and keeps at most 7 pending bits between calls.
+    */
+    #define BINIO_MAX_BITS 57
+
+    /**
+     * @brief Size in bytes of the CRC32C trailer of a checksummed stream, see bchecksum().
+    */
+    #define BINIO_CRC_SIZE 4
+
     /**
      * @brief A type definition for an unsigned char.
      * This is used to represent a byte in the binary stream.
@@ -25,17 +55,38 @@
     */
     typedef unsigned char uchar;
 
+    /**
+     * @brief Background writer of an asynchronous stream, see basync().
+    */
+    struct bflusher;
+
     /**
      * @brief A type definition for a binary stream descriptor.
      * This is used to represent a binary stream.
     */
     struct bfile {
         FILE *file;
-        uchar buffer;
-        unsigned short int buffer_len;
-        unsigned short int bit_pos;
         char mode;
         unsigned short int padding;
+        unsigned short int backend;
+        uint64_t acc;
+        unsigned int acc_len;
+        uchar *obuf;
+        size_t obuf_pos;
+        size_t obuf_cap;
+        uchar *ibuf;
+        size_t ibuf_pos;
+        size_t ibuf_len;
+        unsigned short int eof;
+        unsigned short int error;
+        uint64_t base;
+        unsigned int dropped;
+        struct bflusher *flusher;
+        uchar **mem;
+        size_t *mem_size;
+        unsigned short int checksum;
+        uint32_t crc;
+        size_t crc_pos;
     };
     /**
      * @brief A type definition for a binary stream descriptor.
@@ -49,19 +100,83 @@
      * the file whose name is the string pointed by path and
      * associates a binary stream with it.
      * @param path The relative or absolute path to the file.
-     * @param mode Accepts only two values: 
+     * @param mode Accepts only three values: 
      *      - 'r' for reading; the stream is positioned at the beginning of the file.
      *      - 'w' for writing; the stream is positioned at the beginning of the file; 
      *        if the file does not exist, it is created, otherwise, it is overwritten.
+     *      - 'm' for reading through a memory mapping of the whole file; falls back
+     *        to 'r' when the file can not be mapped (empty or not a regular file).
      * @param padding Boolean value which is true if and only if a padding at the end of the file.
      * @return A pointer to a binary descriptor if successful, otherwise, NULL.
     */
     BFILE *bopen(const char *path, char mode, int padding);
 
+    /**
+     * @brief Opens a binary stream over an open file descriptor, which may be
+     * non-seekable (pipe, socket, standard input or output). The descriptor is
+     * closed by bclose().
+     * @param fd The file descriptor.
+     * @param mode Same values as bopen().
+     * @param padding Boolean value which is true if and only if a padding at the end of the file.
+     * @return A pointer to a binary descriptor if successful, otherwise, NULL.
+    */
+    BFILE *bopen_fd(int fd, char mode, int padding);
+
+    /**
+     * @brief Opens a binary stream reading the size bytes located at data.
+     * The buffer is not copied and must stay valid until bclose() is called.
+     * @param data The location of the bytes to read.
+     * @param size The number of bytes to read.
+     * @param padding Boolean value which is true if and only if a padding at the end of the buffer.
+     * @return A pointer to a binary descriptor if successful, otherwise, NULL.
+    */
+    BFILE *bopen_mem(const void *data, size_t size, int padding);
+
+    /**
+     * @brief Opens a binary stream writing to a heap buffer owned by the caller.
+     * The buffer is grown with realloc() as needed. Upon bclose(), *buf holds
+     * the written bytes and *size their number; the caller must free *buf.
+     * @param buf The location of the buffer, *buf being NULL or allocated with malloc().
+     * @param size The location of the size of the buffer.
+     * @param padding Boolean value which is true if and only if a padding at the end of the buffer.
+     * @return A pointer to a binary descriptor if successful, otherwise, NULL.
+    */
+    BFILE *bopen_membuf(uchar **buf, size_t *size, int padding);
+
+    /**
+     * @brief Turns a file-backed writing stream asynchronous: completed blocks
+     * are written by a background thread while the next one is filled.
+     * bclose() waits for all pending writes.
+     * @param bstream The descriptor of the stream.
+     * @return 0 upon success, otherwise EOF.
+    */
+    int basync(BFILE *bstream);
+
+    /**
+     * @brief Protects a stream with a CRC32C of all its bytes, stored as a
+     * 4-byte trailer after the last one. A writing stream appends the trailer
+     * in bclose(); a reading stream hides it from the data and bclose() fails
+     * if it does not match. Must be called before any bit is read or written.
+     * @param bstream The descriptor of the stream.
+     * @return 0 upon success, otherwise EOF.
+    */
+    int bchecksum(BFILE *bstream);
+
+    /**
+     * @brief Updates a CRC32C (Castagnoli) with len bytes. The SSE4.2 crc32
+     * instruction is used when the processor has it.
+     * @param crc The CRC of the previous bytes, 0 for the first ones.
+     * @param data The location of the bytes.
+     * @param len The number of bytes.
+     * @return The CRC of all the bytes so far.
+    */
+    uint32_t bcrc32c(uint32_t crc, const void *data, size_t len);
+
     /**
      * @brief Closes the binary stream. The bclose() function closes
      * the stream and frees the binary descriptor. In writting mode, if the padding
-     * is enable, it writes the padding pattern before closing. This function must be
+     * is enable, it writes the padding pattern before closing. For a checksummed
+     * stream, it writes or verifies the trailer. This function must be
      * called to end any reading or writing.
      * @param stream The descriptor of the stream.
      * @return 0 upon success, otherwise EOF.
@@ -74,4 +189,59 @@
     int bgetbit(BFILE *bstream);
     void bputbit(uchar b, BFILE *bstream);
 
+    /**
+     * @brief Tells the position of the stream, in bits from the beginning of
+     * the file or buffer: the next bit to read, or the number of bits written.
+     * @param bstream The descriptor of the stream.
+     * @return The position of the stream in bits.
+    */
+    uint64_t btell(BFILE *bstream);
+
+    /**
+     * @brief Moves a reading stream to the given bit offset, reloading its
+     * buffers as needed.
+     * @param bstream The descriptor of the stream.
+     * @param bitpos The offset in bits of the next bit to read.
+     * @return 0 upon success, otherwise EOF.
+    */
+    int bseek(BFILE *bstream, uint64_t bitpos);
+
+    /**
+     * @brief Shows the next nbits bits of the stream without consuming them,
+     * the first one being the most significant. Bits past the end of the
+     * stream read as 0. nbits should not exceed BINIO_MAX_BITS.
+     * @param bstream The descriptor of the stream.
+     * @param nbits The number of bits to show.
+     * @return The next nbits bits of the stream.
+    */
+    uint64_t bpeek(BFILE *bstream, unsigned int nbits);
+
+    /**
+     * @brief Consumes the next nbits bits of the stream.
+     * @param bstream The descriptor of the stream.
+     * @param nbits The number of bits to consume.
+     * @return The number of bits consumed, lower than nbits at the end of the stream.
+    */
+    unsigned int bskip(BFILE *bstream, unsigned int nbits);
+
+    /**
+     * @brief Writes the nbits weakest bits of value in the stream, the most
+     * significant one first. nbits should not exceed BINIO_MAX_BITS.
+     * @param value The bits to write.
+     * @param nbits The number of bits to write.
+     * @param bstream The descriptor of the stream.
+    */
+    void bputbits(uint64_t value, unsigned int nbits, BFILE *bstream);
+
+    /**
+     * @brief Writes n variable-length codes in the stream, code i being the
+     * lens[i] weakest bits of codes[i], the most significant first.
+     * @param bstream The descriptor of the stream.
+     * @param codes The codes to write.
+     * @param lens The lengths in bits of the codes, each between 0 and 32.
+     * @param n The number of codes to write.
+     * @return The number of bits written.
+    */
+    uint64_t bwrite_codes(BFILE *bstream, const uint32_t *codes, const uint8_t *lens, size_t n);
+
 #endif
\ No newline at end of file
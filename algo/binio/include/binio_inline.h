@@ -0,0 +1,177 @@
+/**
+ * @file binio_inline.h
+ * @author bgrolleau001 llunet001
+ * @brief Inline fast path of the binary stream I/O operations.
+ * The functions of this header work on the stream state directly so that the
+ * compiler can keep it in registers across the inner loop of a codec. They do
+ * not check their arguments: the stream must be valid and opened in the right
+ * mode. Only the refill and flush slow paths are calls into binio.c.
+ * @version 0.1
+ * @date 2024-05-28
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef BINIO_INLINE_H
+#define BINIO_INLINE_H
+
+    #include "binio.h"
+
+    /**
+     * @brief Tops up the accumulator of a reading stream from its block buffer.
+     * Slow path of the inline readers, implemented in binio.c.
+     * @param bstream The descriptor of the stream.
+    */
+    void brefill(BFILE *bstream);
+
+    /**
+     * @brief Empties the full output buffer of a writing stream.
+     * Slow path of the inline writers, implemented in binio.c.
+     * @param bstream The descriptor of the stream.
+     * @return 0 upon success, otherwise EOF.
+    */
+    int bflush(BFILE *bstream);
+
+    /**
+     * @brief Stores a 64-bit word at the given location, most significant byte first.
+     * @param p The destination, at least 8 bytes long.
+     * @param v The word to store.
+    */
+    static inline void bstore_be64(uchar *p, uint64_t v)
+    {
+    #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        v = __builtin_bswap64(v);
+        memcpy(p, &v, sizeof(v));
+    #else
+        for (int i = 7; i >= 0; i--)
+        {
+            p[i] = (uchar)v;
+            v >>= 8;
+        }
+    #endif
+    }
+
+    /**
+     * @brief Loads a 64-bit word from the given location, most significant byte first.
+     * @param p The source, at least 8 bytes long.
+     * @return The loaded word.
+    */
+    static inline uint64_t bload_be64(const uchar *p)
+    {
+        uint64_t v;
+    #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(&v, p, sizeof(v));
+        v = __builtin_bswap64(v);
+    #else
+        v = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            v = (v << 8) | p[i];
+        }
+    #endif
+        return v;
+    }
+
+    /**
+     * @brief Inline bputbits(): writes the nbits weakest bits of value, the most
+     * significant one first. Bits of value above nbits are ignored.
+     * @param value The bits to write.
+     * @param nbits The number of bits to write, between 1 and BINIO_MAX_BITS.
+     * @param bstream The descriptor of a writing stream.
+    */
+    static inline void bputbits_fast(uint64_t value, unsigned int nbits, BFILE *bstream)
+    {
+        bstream->acc |= (value << (64 - nbits)) >> bstream->acc_len;
+        bstream->acc_len += nbits;
+
+        unsigned int nbytes = bstream->acc_len >> 3;
+        bstore_be64(bstream->obuf + bstream->obuf_pos, bstream->acc);
+        bstream->obuf_pos += nbytes;
+        // Two shifts since a shift by 64 is undefined
+        bstream->acc <<= nbytes * 4;
+        bstream->acc <<= nbytes * 4;
+        bstream->acc_len &= 7;
+
+        if (bstream->obuf_pos >= bstream->obuf_cap)
+        {
+            bflush(bstream);
+        }
+    }
+
+    /**
+     * @brief Inline bputbit(): writes the weakest bit of b.
+     * @param b The bit to write.
+     * @param bstream The descriptor of a writing stream.
+    */
+    static inline void bputbit_fast(uchar b, BFILE *bstream)
+    {
+        bputbits_fast(b, 1, bstream);
+    }
+
+    /**
+     * @brief Inline bpeek(): shows the next nbits bits without consuming them,
+     * the first one being the most significant. Bits past the end read as 0.
+     * @param bstream The descriptor of a reading stream.
+     * @param nbits The number of bits to show, between 1 and BINIO_MAX_BITS.
+     * @return The next nbits bits of the stream.
+    */
+    static inline uint64_t bpeek_fast(BFILE *bstream, unsigned int nbits)
+    {
+        if (bstream->acc_len < nbits)
+        {
+            brefill(bstream);
+        }
+        return bstream->acc >> (64 - nbits);
+    }
+
+    /**
+     * @brief Inline bskip(): consumes bits already shown by bpeek_fast().
+     * Bits past the end of the stream are not counted.
+     * @param bstream The descriptor of a reading stream.
+     * @param nbits The number of bits to consume, at most BINIO_MAX_BITS.
+     * @return The number of bits consumed.
+    */
+    static inline unsigned int bskip_fast(BFILE *bstream, unsigned int nbits)
+    {
+        unsigned int n = (nbits < bstream->acc_len) ? nbits : bstream->acc_len;
+        bstream->acc <<= n;
+        bstream->acc_len -= n;
+        return n;
+    }
+
+    /**
+     * @brief Tells how many bits the accumulator holds. Right after
+     * bpeek_fast(bstream, nbits), a result below nbits means that the shown
+     * bits run past the end of the stream.
+     * @param bstream The descriptor of a reading stream.
+     * @return The number of bits that can be consumed without a refill.
+    */
+    static inline unsigned int bavail_fast(const BFILE *bstream)
+    {
+        return bstream->acc_len;
+    }
+
+    /**
+     * @brief Inline bgetbit(): reads one bit.
+     * @param bstream The descriptor of a reading stream.
+     * @return The value of the bit or EOF if there is no available bit in the stream.
+    */
+    static inline int bgetbit_fast(BFILE *bstream)
+    {
+        if (bstream->acc_len == 0)
+        {
+            brefill(bstream);
+            if (bstream->acc_len == 0)
+            {
+                return EOF;
+            }
+        }
+
+        int bit = (int)(bstream->acc >> 63);
+        bstream->acc <<= 1;
+        bstream->acc_len--;
+        return bit;
+    }
+
+#endif
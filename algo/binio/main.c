@@ -43,8 +43,8 @@ int main() {
     // ***************************** Test for bgetbit
     int c, i = 1;
     while ((c = bgetbit(input)) != EOF) {
-        DEBUG_PRINT("\t[+] bstream->buffer  = %d (0x%X)\n", input->buffer, input->buffer);
-        DEBUG_PRINT("\t[+] bstream->bit_pos = %d\n", input->bit_pos);
+        DEBUG_PRINT("\t[+] bstream->acc     = 0x%llX\n", (unsigned long long)input->acc);
+        DEBUG_PRINT("\t[+] bstream->acc_len = %d\n", input->acc_len);
         DEBUG_PRINT("\t[+] bit value        = %d\n", c);
         #ifndef DEBUG 
             printf("%d", c);
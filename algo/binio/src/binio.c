@@ -27,17 +27,533 @@
  */
 
 
-#include "../include/binio.h"
+#include "../include/binio_inline.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define BINIO_CRC_SSE42
+#endif
+
+#define R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n) R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n) R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+
+/**
+ * @brief Bit-reversal of every byte value. bread() and bwrite() store the first
+ * bit of the stream in the least significant bit of a byte, while the stream
+ * itself holds it in the most significant one.
+ */
+static const uchar brev[256] = {R6(0), R6(2), R6(1), R6(3)};
+
+#undef R2
+#undef R4
+#undef R6
+
+/**
+ * @brief Reflected polynomial of the CRC32C (Castagnoli).
+ */
+#define BINIO_CRC_POLY 0x82F63B78u
+
+/**
+ * @brief Byte table of the software CRC32C, built once by bcrc_init().
+ */
+static uint32_t bcrc_table[256];
+
+/**
+ * @brief Implementation of bcrc32c() chosen by bcrc_init(), working on the
+ * inverted CRC.
+ */
+static uint32_t (*bcrc_update)(uint32_t crc, const uchar *p, size_t len);
+
+static pthread_once_t bcrc_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Software CRC32C, one table lookup per byte.
+ * @param crc The inverted CRC of the previous bytes.
+ * @param p The location of the bytes.
+ * @param len The number of bytes.
+ * @return The inverted CRC of all the bytes so far.
+ */
+static uint32_t bcrc_update_soft(uint32_t crc, const uchar *p, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = bcrc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef BINIO_CRC_SSE42
+/**
+ * @brief CRC32C with the SSE4.2 crc32 instruction, 8 bytes at a time.
+ * @param crc The inverted CRC of the previous bytes.
+ * @param p The location of the bytes.
+ * @param len The number of bytes.
+ * @return The inverted CRC of all the bytes so far.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t bcrc_update_sse42(uint32_t crc, const uchar *p, size_t len)
+{
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        c = _mm_crc32_u64(c, word);
+    }
+    crc = (uint32_t)c;
+    for (; len > 0; len--)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+/**
+ * @brief Builds the CRC32C table and picks the fastest implementation.
+ */
+static void bcrc_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? BINIO_CRC_POLY : 0);
+        }
+        bcrc_table[i] = crc;
+    }
+
+    bcrc_update = bcrc_update_soft;
+#ifdef BINIO_CRC_SSE42
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        bcrc_update = bcrc_update_sse42;
+    }
+#endif
+}
+
+/**
+ * @brief Reads the next block of the file in the input buffer. The bytes not
+ * consumed yet are moved to the front of the buffer first, so the last byte
+ * of a block stays available until the following block tells whether it is
+ * the last byte of the file. Bytes of a checksummed stream are summed as they
+ * are read, but for the last ones which may be the trailer.
+ * @param bstream The descriptor of the stream.
+ */
+static void bfill(BFILE *bstream)
+{
+    size_t keep = bstream->ibuf_len - bstream->ibuf_pos;
+    memmove(bstream->ibuf, bstream->ibuf + bstream->ibuf_pos, keep);
+
+    size_t wanted = BINIO_BUFFER_SIZE - keep;
+    size_t n = fread(bstream->ibuf + keep, 1, wanted, bstream->file);
+
+    bstream->base += bstream->ibuf_pos;
+    if (bstream->checksum)
+    {
+        bstream->crc_pos -= bstream->ibuf_pos;
+    }
+    bstream->ibuf_pos = 0;
+    bstream->ibuf_len = keep + n;
+    if (n < wanted)
+    {
+        bstream->eof = 1;
+    }
+
+    // The last bytes read may be the trailer, they are summed once others follow
+    if (bstream->checksum && bstream->ibuf_len >= bstream->crc_pos + BINIO_CRC_SIZE)
+    {
+        size_t end = bstream->ibuf_len - BINIO_CRC_SIZE;
+        bstream->crc = bcrc32c(bstream->crc, bstream->ibuf + bstream->crc_pos, end - bstream->crc_pos);
+        bstream->crc_pos = end;
+    }
+}
+
+/**
+ * @brief Tops up the bit accumulator of a reading stream with whole bytes of the
+ * input buffer until it holds more than 56 bits or the stream is exhausted.
+ * In padding mode, only the data bits of the last byte of the file are loaded.
+ * @param bstream The descriptor of the stream.
+ */
+void brefill(BFILE *bstream)
+{
+    // In padding mode, the byte following the current one must be known to tell whether it is the last
+    size_t lookahead = bstream->padding ? 1 : 0;
+    // The trailer of a checksummed stream is not data
+    size_t hold = bstream->checksum ? BINIO_CRC_SIZE : 0;
+
+    while (bstream->acc_len <= 56)
+    {
+        size_t avail = bstream->ibuf_len - bstream->ibuf_pos;
+
+        if (avail >= 8 + lookahead + hold)
+        {
+            unsigned int nbytes = (64 - bstream->acc_len) >> 3;
+            uint64_t word = bload_be64(bstream->ibuf + bstream->ibuf_pos);
+            word >>= 64 - 8 * nbytes;
+            bstream->acc |= word << (64 - bstream->acc_len - 8 * nbytes);
+            bstream->acc_len += 8 * nbytes;
+            bstream->ibuf_pos += nbytes;
+            continue;
+        }
+
+        if (avail <= lookahead + hold && !bstream->eof)
+        {
+            bfill(bstream);
+            continue;
+        }
+
+        if (avail <= hold)
+        {
+            return;
+        }
+
+        uchar byte = bstream->ibuf[bstream->ibuf_pos++];
+        unsigned int nbits = 8;
+        if (bstream->padding && bstream->eof && avail == hold + 1)
+        {
+            // Data bits stop right before the last bit set
+            nbits = (byte == 0) ? 0 : 7 - __builtin_ctz(byte);
+            bstream->dropped = 8 - nbits;
+            DEBUG_PRINT("[DEBUG] (BINIO) Padding found, %d data bits in the last byte\n", nbits);
+            if (nbits == 0)
+            {
+                return;
+            }
+            byte >>= 8 - nbits;
+        }
+        bstream->acc |= (uint64_t)byte << (64 - bstream->acc_len - nbits);
+        bstream->acc_len += nbits;
+    }
+}
+
+/**
+ * @brief State of the background thread of an asynchronous writing stream.
+ * At most one block is pending at any time: the thread writes it while the
+ * encoder fills the other one.
+ */
+struct bflusher
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uchar *block;
+    size_t block_len;
+    uchar *spare;
+    int stop;
+    int error;
+};
+
+/**
+ * @brief Body of the background thread of an asynchronous writing stream.
+ * It writes every block it is handed to the file, until it is asked to stop.
+ * @param arg The descriptor of the stream.
+ * @return NULL.
+ */
+static void *bflusher_run(void *arg)
+{
+    BFILE *bstream = (BFILE *)arg;
+    struct bflusher *fl = bstream->flusher;
+
+    pthread_mutex_lock(&fl->lock);
+    for (;;)
+    {
+        while (fl->block == NULL && !fl->stop)
+        {
+            pthread_cond_wait(&fl->cond, &fl->lock);
+        }
+        if (fl->block == NULL)
+        {
+            break;
+        }
+
+        uchar *block = fl->block;
+        size_t len = fl->block_len;
+        pthread_mutex_unlock(&fl->lock);
+        size_t written = fwrite(block, 1, len, bstream->file);
+        pthread_mutex_lock(&fl->lock);
+
+        if (written != len)
+        {
+            fl->error = 1;
+        }
+        fl->block = NULL;
+        pthread_cond_broadcast(&fl->cond);
+    }
+    pthread_mutex_unlock(&fl->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Hands the output buffer of an asynchronous stream to its background
+ * thread, once the previous block is written, and carries on in the spare one.
+ * @param bstream The descriptor of the stream.
+ * @param pending The number of bytes of the output buffer to write.
+ */
+static void bflusher_push(BFILE *bstream, size_t pending)
+{
+    struct bflusher *fl = bstream->flusher;
+    uchar *block = bstream->obuf;
+
+    pthread_mutex_lock(&fl->lock);
+    while (fl->block != NULL)
+    {
+        pthread_cond_wait(&fl->cond, &fl->lock);
+    }
+    fl->block = block;
+    fl->block_len = pending;
+    pthread_cond_broadcast(&fl->cond);
+    pthread_mutex_unlock(&fl->lock);
+
+    // The spare buffer was the previous block, which is written by now
+    bstream->obuf = fl->spare;
+    fl->spare = block;
+}
+
+/**
+ * @brief Waits for the last block of an asynchronous stream to be written and
+ * stops its background thread.
+ * @param bstream The descriptor of the stream.
+ */
+static void bflusher_stop(BFILE *bstream)
+{
+    struct bflusher *fl = bstream->flusher;
+
+    pthread_mutex_lock(&fl->lock);
+    fl->stop = 1;
+    pthread_cond_broadcast(&fl->cond);
+    pthread_mutex_unlock(&fl->lock);
+    pthread_join(fl->thread, NULL);
+
+    if (fl->error)
+    {
+        bstream->error = 1;
+    }
+    free(fl->spare);
+    pthread_mutex_destroy(&fl->lock);
+    pthread_cond_destroy(&fl->cond);
+    free(fl);
+    bstream->flusher = NULL;
+}
+
+/**
+ * @brief Empties the output buffer. For a file, the completed bytes are summed
+ * if needed and written to it. For a memory buffer, the buffer capacity is
+ * doubled instead.
+ * @param bstream The descriptor of the stream.
+ * @return 0 upon success, otherwise EOF.
+ */
+int bflush(BFILE *bstream)
+{
+    if (bstream->backend == BINIO_BACKEND_MEM)
+    {
+        size_t cap = 2 * bstream->obuf_cap;
+        uchar *obuf = (uchar *)realloc(bstream->obuf, cap + sizeof(uint64_t));
+        if (obuf == NULL)
+        {
+            // The written bytes are dropped, bclose() reports the failure
+            bstream->obuf_pos = 0;
+            bstream->error = 1;
+            return EOF;
+        }
+        bstream->obuf = obuf;
+        bstream->obuf_cap = cap;
+        *bstream->mem = obuf;
+        return 0;
+    }
+
+    if (bstream->obuf_pos == 0)
+    {
+        return 0;
+    }
+
+    size_t pending = bstream->obuf_pos;
+    bstream->base += pending;
+    bstream->obuf_pos = 0;
+    if (bstream->checksum)
+    {
+        bstream->crc = bcrc32c(bstream->crc, bstream->obuf, pending);
+    }
+    if (bstream->flusher != NULL)
+    {
+        bflusher_push(bstream, pending);
+        return 0;
+    }
+    if (fwrite(bstream->obuf, 1, pending, bstream->file) != pending)
+    {
+        bstream->error = 1;
+        return EOF;
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks the trailer of a checksummed reading stream. The bytes not read
+ * yet are summed too, so the whole stream is checked even if it was not read
+ * to the end.
+ * @param bstream The descriptor of the stream.
+ * @return 0 if the trailer matches, otherwise EOF.
+ */
+static int bverify(BFILE *bstream)
+{
+    if (bstream->backend == BINIO_BACKEND_FILE)
+    {
+        while (!bstream->eof)
+        {
+            bstream->ibuf_pos = bstream->crc_pos;
+            bfill(bstream);
+        }
+    }
+    else if (bstream->ibuf_len >= bstream->crc_pos + BINIO_CRC_SIZE)
+    {
+        // The whole buffer is at hand, it is summed at once
+        bstream->crc = bcrc32c(0, bstream->ibuf + bstream->crc_pos, bstream->ibuf_len - BINIO_CRC_SIZE - bstream->crc_pos);
+        bstream->crc_pos = bstream->ibuf_len - BINIO_CRC_SIZE;
+    }
+
+    if (bstream->ibuf_len - bstream->crc_pos != BINIO_CRC_SIZE)
+    {
+        DEBUG_PRINT("[DEBUG] (BINIO) Stream too short for its checksum\n");
+        return EOF;
+    }
+
+    uint32_t crc = bstream->crc;
+    const uchar *trailer = bstream->ibuf + bstream->crc_pos;
+    uint32_t expected = (uint32_t)trailer[0] << 24 | (uint32_t)trailer[1] << 16 | (uint32_t)trailer[2] << 8 | trailer[3];
+    DEBUG_PRINT("[DEBUG] (BINIO) Checksum %08x, expected %08x\n", crc, expected);
+    return (crc == expected) ? 0 : EOF;
+}
+
+/**
+ * @brief Allocates a binary descriptor in its initial state.
+ * @param mode The mode of the stream.
+ * @param padding Boolean value which is true if and only if a padding at the end of the stream.
+ * @return A pointer to a binary descriptor if successful, otherwise, NULL.
+ */
+static BFILE *balloc(char mode, int padding)
+{
+    BFILE *bstream = (BFILE *)malloc(sizeof(BFILE));
+    if (bstream == NULL)
+    {
+        return NULL;
+    }
+
+    bstream->file = NULL;
+    bstream->mode = mode;
+    bstream->padding = padding;
+    bstream->backend = BINIO_BACKEND_FILE;
+    bstream->acc = 0;
+    bstream->acc_len = 0;
+    bstream->obuf = NULL;
+    bstream->obuf_pos = 0;
+    bstream->obuf_cap = BINIO_BUFFER_SIZE;
+    bstream->ibuf = NULL;
+    bstream->ibuf_pos = 0;
+    bstream->ibuf_len = 0;
+    bstream->eof = 0;
+    bstream->error = 0;
+    bstream->base = 0;
+    bstream->dropped = 0;
+    bstream->flusher = NULL;
+    bstream->mem = NULL;
+    bstream->mem_size = NULL;
+    bstream->checksum = 0;
+    bstream->crc = 0;
+    bstream->crc_pos = 0;
+
+    return bstream;
+}
+
+/**
+ * @brief Maps a whole regular file in memory to serve it as the input buffer
+ * of a reading stream. The kernel is told the mapping is read sequentially.
+ * The stream starts at the current offset of the descriptor.
+ * @param bstream The descriptor of the stream.
+ * @param fd The file descriptor, which stays open.
+ * @return 0 upon success, otherwise EOF if the file can not be mapped
+ *         (it is empty or is not a regular file).
+ */
+static int bmap(BFILE *bstream, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        return EOF;
+    }
+
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0 || offset > st.st_size)
+    {
+        offset = 0;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return EOF;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    bstream->ibuf = (uchar *)map;
+    bstream->ibuf_pos = (size_t)offset;
+    bstream->ibuf_len = (size_t)st.st_size;
+    bstream->backend = BINIO_BACKEND_MMAP;
+    bstream->eof = 1;
+    return 0;
+}
+
+/**
+ * @brief Allocates the block buffer of a stream backed by a FILE.
+ * On failure, the file is closed and the descriptor freed.
+ * @param bstream The descriptor of the stream, whose file is open.
+ * @return The descriptor upon success, otherwise NULL.
+ */
+static BFILE *bbuffer(BFILE *bstream)
+{
+    // Positions are file offsets, for a descriptor not at the beginning of a file too
+    off_t offset = ftello(bstream->file);
+    bstream->base = (offset > 0) ? (uint64_t)offset : 0;
+
+    if (bstream->mode == 'w')
+    {
+        // 8 spare bytes let bputbits() store a whole word past the last completed byte
+        bstream->obuf = (uchar *)malloc(BINIO_BUFFER_SIZE + sizeof(uint64_t));
+    }
+    else
+    {
+        bstream->ibuf = (uchar *)malloc(BINIO_BUFFER_SIZE);
+    }
+
+    if (bstream->obuf == NULL && bstream->ibuf == NULL)
+    {
+        fclose(bstream->file);
+        free(bstream);
+        return NULL;
+    }
+
+    return bstream;
+}
 
 /**
  * @brief Opens a binary stream. The bopen() function opens
  * the file whose name is the string pointed by path and
  * associates a binary stream with it.
  * @param path The relative or absolute path to the file.
- * @param mode Accepts only two values:
+ * @param mode Accepts only three values:
  *      - 'r' for reading; the stream is positioned at the beginning of the file.
  *      - 'w' for writing; the stream is positioned at the beginning of the file;
  *        if the file does not exist, it is created, otherwise, it is overwritten.
+ *      - 'm' for reading through a memory mapping of the whole file; falls back
+ *        to 'r' when the file can not be mapped (empty or not a regular file).
  * @param padding Boolean value which is true if and only if a padding at the end of the file.
  * @return A pointer to a binary descriptor if successful, otherwise, NULL.
  */
@@ -45,7 +561,7 @@ BFILE *bopen(const char *path, char mode, int padding)
 {
     DEBUG_PRINT("[DEBUG] (BINIO) bopen(path = %s, mode = %c, padding = %d)\n", path, mode, padding);
 
-    BFILE *bstream = (BFILE *)malloc(sizeof(BFILE));
+    BFILE *bstream = balloc(mode, padding);
     if (bstream == NULL)
     {
         return NULL;
@@ -53,10 +569,24 @@ BFILE *bopen(const char *path, char mode, int padding)
 
     switch (mode)
     {
+    case 'm':
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0)
+        {
+            int mapped = bmap(bstream, fd);
+            close(fd);
+            if (mapped == 0)
+            {
+                return bstream;
+            }
+        }
+    }
+        // fall through
     case 'r':
     case 'w':
     {
-        char modeStr[3] = {mode, 'b', '\0'};
+        char modeStr[3] = {mode == 'w' ? 'w' : 'r', 'b', '\0'};
         bstream->file = fopen(path, modeStr);
         break;
     }
@@ -71,19 +601,243 @@ BFILE *bopen(const char *path, char mode, int padding)
         return NULL;
     }
 
-    bstream->buffer = 0;
-    bstream->buffer_len = 0;
-    bstream->bit_pos = 0;
-    bstream->mode = mode;
-    bstream->padding = padding;
+    return bbuffer(bstream);
+}
+
+/**
+ * @brief Opens a binary stream over an already open file descriptor, such as
+ * a pipe, a socket or the standard input or output. The descriptor belongs to
+ * the stream from then on and is closed by bclose(). Reading never seeks: the
+ * last byte, which holds the padding, is found with a one-byte lookahead.
+ * @param fd The file descriptor, open for reading or writing according to mode.
+ * @param mode Same values as bopen(). With 'm', a regular file is mapped from
+ *             the current offset of the descriptor.
+ * @param padding Boolean value which is true if and only if a padding at the end of the file.
+ * @return A pointer to a binary descriptor if successful, otherwise, NULL.
+ */
+BFILE *bopen_fd(int fd, char mode, int padding)
+{
+    DEBUG_PRINT("[DEBUG] (BINIO) bopen_fd(fd = %d, mode = %c, padding = %d)\n", fd, mode, padding);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    BFILE *bstream = balloc(mode, padding);
+    if (bstream == NULL)
+    {
+        return NULL;
+    }
+
+    switch (mode)
+    {
+    case 'm':
+        if (bmap(bstream, fd) == 0)
+        {
+            close(fd);
+            return bstream;
+        }
+        // fall through
+    case 'r':
+    case 'w':
+    {
+        char modeStr[3] = {mode == 'w' ? 'w' : 'r', 'b', '\0'};
+        bstream->file = fdopen(fd, modeStr);
+        break;
+    }
+    default:
+        free(bstream);
+        return NULL;
+    }
+
+    if (bstream->file == NULL)
+    {
+        free(bstream);
+        return NULL;
+    }
+
+    return bbuffer(bstream);
+}
+
+/**
+ * @brief Opens a binary stream reading from memory. The bopen_mem() function
+ * associates a binary stream with the size bytes located at data. The buffer
+ * is neither copied nor freed, it must stay valid until bclose() is called.
+ * @param data The location of the bytes to read.
+ * @param size The number of bytes to read.
+ * @param padding Boolean value which is true if and only if a padding at the end of the buffer.
+ * @return A pointer to a binary descriptor if successful, otherwise, NULL.
+ */
+BFILE *bopen_mem(const void *data, size_t size, int padding)
+{
+    DEBUG_PRINT("[DEBUG] (BINIO) bopen_mem(data = %p, size = %zu, padding = %d)\n", data, size, padding);
+
+    if (data == NULL && size > 0)
+    {
+        return NULL;
+    }
+
+    BFILE *bstream = balloc('r', padding);
+    if (bstream == NULL)
+    {
+        return NULL;
+    }
+
+    bstream->backend = BINIO_BACKEND_MEM;
+    bstream->ibuf = (uchar *)data;
+    bstream->ibuf_len = size;
+    bstream->eof = 1;
+
+    return bstream;
+}
+
+/**
+ * @brief Opens a binary stream writing to memory. The bopen_membuf() function
+ * associates a binary stream with a heap buffer owned by the caller, which is
+ * grown with realloc() as bits are written.
+ * @param buf The location of the buffer. *buf is either NULL or a buffer
+ *            allocated with malloc() of *size bytes. Upon bclose(), it holds
+ *            the written bytes and must be freed by the caller.
+ * @param size The location of the size of the buffer. Upon bclose(), it holds
+ *             the number of written bytes.
+ * @param padding Boolean value which is true if and only if a padding at the end of the buffer.
+ * @return A pointer to a binary descriptor if successful, otherwise, NULL.
+ */
+BFILE *bopen_membuf(uchar **buf, size_t *size, int padding)
+{
+    DEBUG_PRINT("[DEBUG] (BINIO) bopen_membuf(buf = %p, size = %p, padding = %d)\n", buf, size, padding);
+
+    if (buf == NULL || size == NULL)
+    {
+        return NULL;
+    }
+
+    size_t cap = (*buf != NULL && *size > BINIO_MEM_MIN_SIZE) ? *size : BINIO_MEM_MIN_SIZE;
+    uchar *mem = (uchar *)realloc(*buf, cap);
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+    *buf = mem;
+
+    BFILE *bstream = balloc('w', padding);
+    if (bstream == NULL)
+    {
+        return NULL;
+    }
+
+    bstream->backend = BINIO_BACKEND_MEM;
+    bstream->obuf = mem;
+    // The last 8 bytes are the spare room of bputbits()
+    bstream->obuf_cap = cap - sizeof(uint64_t);
+    bstream->mem = buf;
+    bstream->mem_size = size;
 
     return bstream;
 }
 
+/**
+ * @brief Turns a file-backed writing stream asynchronous. A background thread
+ * then writes every completed output block while the caller keeps filling the
+ * next one, so encoding and I/O overlap. bclose() waits for all the pending
+ * writes and reports their failures.
+ * @param bstream The descriptor of the stream.
+ * @return 0 upon success, otherwise EOF (not a file-backed writing stream, or
+ *         the thread could not be started).
+ */
+int basync(BFILE *bstream)
+{
+    DEBUG_PRINT("[DEBUG] (BINIO) basync(%p)\n", bstream);
+
+    if (bstream == NULL || bstream->mode != 'w' || bstream->backend != BINIO_BACKEND_FILE)
+    {
+        return EOF;
+    }
+    if (bstream->flusher != NULL)
+    {
+        return 0;
+    }
+
+    struct bflusher *fl = (struct bflusher *)malloc(sizeof(struct bflusher));
+    if (fl == NULL)
+    {
+        return EOF;
+    }
+    fl->spare = (uchar *)malloc(BINIO_BUFFER_SIZE + sizeof(uint64_t));
+    if (fl->spare == NULL)
+    {
+        free(fl);
+        return EOF;
+    }
+    fl->block = NULL;
+    fl->block_len = 0;
+    fl->stop = 0;
+    fl->error = 0;
+    pthread_mutex_init(&fl->lock, NULL);
+    pthread_cond_init(&fl->cond, NULL);
+
+    bstream->flusher = fl;
+    if (pthread_create(&fl->thread, NULL, bflusher_run, bstream) != 0)
+    {
+        pthread_mutex_destroy(&fl->lock);
+        pthread_cond_destroy(&fl->cond);
+        free(fl->spare);
+        free(fl);
+        bstream->flusher = NULL;
+        return EOF;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Protects a stream with a CRC32C of all its bytes. A writing stream
+ * sums the bytes as its buffer is flushed and bclose() appends the CRC as a
+ * 4-byte big-endian trailer, after the padding. A reading stream holds back
+ * the last 4 bytes, which are never read as data, and bclose() checks them.
+ * A checksummed file-backed reading stream can only seek inside its current
+ * block.
+ * @param bstream The descriptor of the stream, on which no bit has been read
+ *                or written yet.
+ * @return 0 upon success, otherwise EOF.
+ */
+int bchecksum(BFILE *bstream)
+{
+    DEBUG_PRINT("[DEBUG] (BINIO) bchecksum(%p)\n", bstream);
+
+    if (bstream == NULL || bstream->acc_len > 0 || bstream->obuf_pos > 0
+        || (bstream->backend == BINIO_BACKEND_FILE && bstream->ibuf_len > 0))
+    {
+        return EOF;
+    }
+
+    bstream->checksum = 1;
+    bstream->crc = 0;
+    // Mapped files start at the offset of their descriptor
+    bstream->crc_pos = bstream->ibuf_pos;
+    return 0;
+}
+
+/**
+ * @brief Updates a CRC32C (Castagnoli) with len bytes. The SSE4.2 crc32
+ * instruction is used when the processor has it, a table otherwise.
+ * @param crc The CRC of the previous bytes, 0 for the first ones.
+ * @param data The location of the bytes.
+ * @param len The number of bytes.
+ * @return The CRC of all the bytes so far.
+ */
+uint32_t bcrc32c(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&bcrc_once, bcrc_init);
+    return ~bcrc_update(~crc, (const uchar *)data, len);
+}
+
 /**
  * @brief Closes the binary stream. The bclose() function closes
  * the stream and frees the binary descriptor. In writting mode, if the padding
- * is enable, it writes the padding pattern before closing. This function must be
+ * is enable, it writes the padding pattern before closing. A checksummed stream
+ * gets its trailer written, or checked in reading mode. This function must be
  * called to end any reading or writing.
  * @param stream The descriptor of the stream.
  * @return 0 upon success, otherwise EOF.
@@ -97,34 +851,67 @@ int bclose(BFILE *stream)
         return EOF;
     }
 
+    int result = 0;
     if (stream->mode == 'w')
     {
         if (stream->padding)
         {
-            if (stream->buffer == 0)
-            {
-                DEBUG_PRINT("[DEBUG] (BINIO) \tBuffer is empty so added 0x80\n");
-                fputc(0x80, stream->file);
-            }
-            else
+            DEBUG_PRINT("[DEBUG] (BINIO) \tPadding bit added at position %d\n", stream->acc_len);
+            bputbits(1, 1, stream);
+        }
+        if (stream->acc_len > 0)
+        {
+            bputbits(0, 8 - stream->acc_len, stream);
+        }
+        if (stream->checksum)
+        {
+            // The trailer goes in the spare room of the output buffer and is not summed
+            uint32_t crc = bcrc32c(stream->crc, stream->obuf, stream->obuf_pos);
+            stream->checksum = 0;
+            for (int shift = 24; shift >= 0; shift -= 8)
             {
-                DEBUG_PRINT("[DEBUG] (BINIO) \tPadding bit added at position %d\n", stream->bit_pos);
-                DEBUG_PRINT("[DEBUG] (BINIO) \tBuffer before padding: 0x%X\n", stream->buffer);
-                stream->buffer |= (1 << (7 - stream->bit_pos));
-                DEBUG_PRINT("[DEBUG] (BINIO) \tBuffer after padding: 0x%X\n", stream->buffer);
-                fputc(stream->buffer, stream->file);
+                stream->obuf[stream->obuf_pos++] = (uchar)(crc >> shift);
             }
         }
+        if (stream->backend == BINIO_BACKEND_MEM)
+        {
+            *stream->mem = stream->obuf;
+            *stream->mem_size = stream->obuf_pos;
+        }
         else
         {
-            if (stream->bit_pos > 0)
+            bflush(stream);
+            if (stream->flusher != NULL)
             {
-                fputc(stream->buffer, stream->file);
+                bflusher_stop(stream);
             }
+            free(stream->obuf);
+        }
+        if (stream->error)
+        {
+            result = EOF;
+        }
+    }
+    else
+    {
+        if (stream->checksum && bverify(stream) != 0)
+        {
+            result = EOF;
+        }
+        if (stream->backend == BINIO_BACKEND_MMAP)
+        {
+            munmap(stream->ibuf, stream->ibuf_len);
+        }
+        else if (stream->backend == BINIO_BACKEND_FILE)
+        {
+            free(stream->ibuf);
         }
     }
 
-    int result = fclose(stream->file);
+    if (stream->file != NULL && fclose(stream->file) != 0)
+    {
+        result = EOF;
+    }
     free(stream);
 
     return result;
@@ -144,42 +931,87 @@ int bclose(BFILE *stream)
  */
 unsigned int bread(void *ptr, unsigned int nbits, BFILE *bstream)
 {
-    if (bstream == NULL || bstream->file == NULL)
+    if (bstream == NULL || bstream->ibuf == NULL)
     {
         return 0;
     }
 
     unsigned char *bytes = (unsigned char *)ptr;
-    unsigned int bitsRead = 0;
+    unsigned int nbytes = nbits / 8;
     unsigned int byteIndex = 0;
-    unsigned int bitPos = 0;
-
-    unsigned int nbytes = (nbits + 7) / 8;
-    for (unsigned int i = 0; i < nbytes; i++)
+    // The last byte of a padded stream must go through brefill() to strip the padding
+    size_t reserve = bstream->padding ? 1 : 0;
+    if (bstream->checksum)
     {
-        bytes[i] = 0;
+        reserve += BINIO_CRC_SIZE;
     }
 
-    for (unsigned int i = 0; i < nbits; i++)
+    while (byteIndex < nbytes)
     {
-        int bit = bgetbit(bstream);
-        if (bit == EOF)
+        // Whole bytes already in the accumulator, aligned or not
+        while (bstream->acc_len >= 8 && byteIndex < nbytes)
+        {
+            bytes[byteIndex++] = brev[bstream->acc >> 56];
+            bstream->acc <<= 8;
+            bstream->acc_len -= 8;
+        }
+        if (byteIndex == nbytes)
         {
             break;
         }
 
-        if (bit)
+        // Byte-aligned and empty accumulator: copy straight from the input buffer
+        size_t avail = bstream->ibuf_len - bstream->ibuf_pos;
+        if (bstream->acc_len == 0 && avail > reserve)
+        {
+            size_t n = avail - reserve;
+            if (n > nbytes - byteIndex)
+            {
+                n = nbytes - byteIndex;
+            }
+            const uchar *src = bstream->ibuf + bstream->ibuf_pos;
+            for (size_t i = 0; i < n; i++)
+            {
+                bytes[byteIndex + i] = brev[src[i]];
+            }
+            byteIndex += n;
+            bstream->ibuf_pos += n;
+            continue;
+        }
+
+        unsigned int before = bstream->acc_len;
+        brefill(bstream);
+        if (bstream->acc_len == before)
         {
-            bytes[byteIndex] |= (1 << bitPos);
+            break;
         }
+    }
 
-        bitPos++;
-        if (bitPos == 8)
+    unsigned int bitsRead = 8 * byteIndex;
+    unsigned int total = (nbits + 7) / 8;
+    memset(bytes + byteIndex, 0, total - byteIndex);
+
+    if (byteIndex == nbytes)
+    {
+        for (unsigned int bitPos = 0; bitsRead < nbits; bitPos++)
+        {
+            int bit = bgetbit(bstream);
+            if (bit == EOF)
+            {
+                break;
+            }
+            bytes[byteIndex] |= bit << bitPos;
+            bitsRead++;
+        }
+    }
+    else
+    {
+        // End of stream inside a byte: hand out the remaining bits
+        for (unsigned int bitPos = 0; bstream->acc_len > 0; bitPos++)
         {
-            bitPos = 0;
-            byteIndex++;
+            bytes[byteIndex] |= bgetbit(bstream) << bitPos;
+            bitsRead++;
         }
-        bitsRead++;
     }
 
     return bitsRead;
@@ -199,33 +1031,69 @@ unsigned int bread(void *ptr, unsigned int nbits, BFILE *bstream)
 unsigned int bwrite(void *ptr, unsigned int nbits, BFILE *bstream)
 {
     DEBUG_PRINT("[DEBUG] (BINIO) bwrite(%p, %d, %p)\n", ptr, nbits, bstream);
-    if (ptr == NULL || bstream == NULL || bstream->file == NULL)
+    if (ptr == NULL || bstream == NULL || bstream->obuf == NULL)
     {
         return 0;
     }
 
-    unsigned char *bytes = (unsigned char *)ptr;
-    unsigned int bitsWritten = 0;
-
-    unsigned int nbytes = (nbits + 7) / 8;
+    const unsigned char *bytes = (const unsigned char *)ptr;
+    unsigned int nbytes = nbits / 8;
+    unsigned int byteIndex = 0;
 
-    for (unsigned int i = 0; i < nbytes; i++)
+    if (bstream->acc_len == 0)
     {
-        for (int j = 0; j <= 7; j++)
+        // Byte-aligned: copy straight to the output buffer
+        while (byteIndex < nbytes)
         {
-            if (bitsWritten < nbits)
+            size_t n = bstream->obuf_cap - bstream->obuf_pos;
+            if (n > nbytes - byteIndex)
+            {
+                n = nbytes - byteIndex;
+            }
+            uchar *dst = bstream->obuf + bstream->obuf_pos;
+            for (size_t i = 0; i < n; i++)
+            {
+                dst[i] = brev[bytes[byteIndex + i]];
+            }
+            byteIndex += n;
+            bstream->obuf_pos += n;
+            if (bstream->obuf_pos >= bstream->obuf_cap)
             {
-                bputbit((bytes[i] >> j) & 1, bstream);
-                bitsWritten++;
+                bflush(bstream);
             }
         }
     }
+    else
+    {
+        // Unaligned: merge 7 bytes at a time in the accumulator
+        while (nbytes - byteIndex >= 7)
+        {
+            uint64_t word = 0;
+            for (int i = 0; i < 7; i++)
+            {
+                word = (word << 8) | brev[bytes[byteIndex + i]];
+            }
+            bputbits(word, 56, bstream);
+            byteIndex += 7;
+        }
+        while (byteIndex < nbytes)
+        {
+            bputbits(brev[bytes[byteIndex++]], 8, bstream);
+        }
+    }
 
-    return bitsWritten;
+    unsigned int rest = nbits % 8;
+    if (rest > 0)
+    {
+        bputbits(brev[bytes[nbytes]] >> (8 - rest), rest, bstream);
+    }
+
+    return nbits;
 }
 
 /**
- * @brief Reads one bit in the stream.
+ * @brief Reads one bit in the stream. Bits are served from the 64-bit
+ * accumulator, which is refilled from the block buffer once empty.
  * @param bstream The descriptor of the stream.
  * @return The value of the bit or EOF if there is no available bit in the stream.
  */
@@ -233,67 +1101,147 @@ int bgetbit(BFILE *bstream)
 {
     DEBUG_PRINT("[DEBUG] (BINIO) bgetbit(%p)\n", bstream);
 
-    if (bstream == NULL || bstream->file == NULL)
+    if (bstream == NULL || bstream->ibuf == NULL)
     {
         return EOF;
     }
 
-    if (bstream->bit_pos == 0)
+    return bgetbit_fast(bstream);
+}
+
+/**
+ * @brief Tells the position of the stream. In reading mode, it is the offset of
+ * the next bit to read, in writing mode, the number of bits written so far.
+ * Offsets are counted in bits from the beginning of the file or buffer.
+ * @param bstream The descriptor of the stream.
+ * @return The position of the stream in bits, 0 if bstream is NULL.
+ */
+uint64_t btell(BFILE *bstream)
+{
+    if (bstream == NULL)
     {
-        if (feof(bstream->file))
-        {
-            return EOF;
-        }
-        int buffer = fgetc(bstream->file);
-        if (buffer == EOF)
+        return 0;
+    }
+
+    if (bstream->mode == 'w')
+    {
+        return 8 * (bstream->base + bstream->obuf_pos) + bstream->acc_len;
+    }
+    return 8 * (bstream->base + bstream->ibuf_pos) - bstream->acc_len - bstream->dropped;
+}
+
+/**
+ * @brief Moves a reading stream to the given bit offset, as returned by btell().
+ * A target inside the current input block only moves the read position, other
+ * targets seek the file and reload the block. Mapped and memory streams seek in
+ * constant time; stdio streams need a seekable file.
+ * @param bstream The descriptor of the stream.
+ * @param bitpos The offset in bits of the next bit to read.
+ * @return 0 upon success, otherwise EOF (writing stream, non-seekable file or
+ *         offset past the end of the stream).
+ */
+int bseek(BFILE *bstream, uint64_t bitpos)
+{
+    DEBUG_PRINT("[DEBUG] (BINIO) bseek(%p, %llu)\n", bstream, (unsigned long long)bitpos);
+
+    if (bstream == NULL || bstream->ibuf == NULL)
+    {
+        return EOF;
+    }
+
+    uint64_t byte = bitpos / 8;
+    // Bytes of a checksummed file past the summed ones must be read in order
+    int summed = bstream->checksum && bstream->backend == BINIO_BACKEND_FILE;
+    size_t limit = summed ? bstream->crc_pos : bstream->ibuf_len;
+    if (byte >= bstream->base && byte - bstream->base <= limit)
+    {
+        bstream->ibuf_pos = byte - bstream->base;
+    }
+    else if (bstream->backend == BINIO_BACKEND_FILE && !summed)
+    {
+        // fseeko() goes past the end of a file without complaint
+        struct stat st;
+        if (fstat(fileno(bstream->file), &st) != 0 || (S_ISREG(st.st_mode) && byte > (uint64_t)st.st_size)
+            || fseeko(bstream->file, (off_t)byte, SEEK_SET) != 0)
         {
             return EOF;
         }
+        bstream->base = byte;
+        bstream->ibuf_pos = 0;
+        bstream->ibuf_len = 0;
+        bstream->eof = 0;
+    }
+    else
+    {
+        return EOF;
+    }
 
-        bstream->buffer = buffer;
-        bstream->buffer_len = 8;
-        bstream->bit_pos = 8;
+    bstream->acc = 0;
+    bstream->acc_len = 0;
+    bstream->dropped = 0;
 
-        if (bstream->padding)
-        {
-            long long pos = ftell(bstream->file);
-            fseek(bstream->file, 0, SEEK_END);
-            long long end = ftell(bstream->file);
-            fseek(bstream->file, pos, SEEK_SET);
+    unsigned int rest = bitpos % 8;
+    return (bskip(bstream, rest) == rest) ? 0 : EOF;
+}
+
+/**
+ * @brief Shows the next bits of the stream without consuming them. The first
+ * bit of the stream is the most significant of the nbits returned ones. Past
+ * the end of the stream (or of the data before the padding pattern), the
+ * missing bits read as 0; use bskip() to know how many bits are really left.
+ * @param bstream The descriptor of the stream.
+ * @param nbits The number of bits to show, at most BINIO_MAX_BITS.
+ * @return The next nbits bits of the stream.
+ */
+uint64_t bpeek(BFILE *bstream, unsigned int nbits)
+{
+    if (bstream == NULL || bstream->ibuf == NULL || nbits == 0)
+    {
+        return 0;
+    }
 
-            if (pos == end)
+    // Bits of the accumulator past acc_len are always 0
+    return bpeek_fast(bstream, nbits);
+}
+
+/**
+ * @brief Consumes bits of the stream, usually after a bpeek().
+ * @param bstream The descriptor of the stream.
+ * @param nbits The number of bits to consume.
+ * @return The number of bits consumed, lower than nbits if the end of the stream is reached.
+ */
+unsigned int bskip(BFILE *bstream, unsigned int nbits)
+{
+    if (bstream == NULL || bstream->ibuf == NULL)
+    {
+        return 0;
+    }
+
+    unsigned int skipped = 0;
+    while (skipped < nbits)
+    {
+        if (bstream->acc_len == 0)
+        {
+            brefill(bstream);
+            if (bstream->acc_len == 0)
             {
-                if (bstream->buffer == 0x80)
-                {
-                    return EOF;
-                }
-                else
-                {
-                    int paddingBitPos = 0;
-                    while (paddingBitPos >= 0 && !((bstream->buffer >> paddingBitPos) & 1))
-                    {
-                        paddingBitPos++;
-                    }
-
-                    bstream->buffer_len -= paddingBitPos + 1;
-                    DEBUG_PRINT("[DEBUG] (BINIO) Padding bit found at position %d\n", paddingBitPos);
-                    DEBUG_PRINT("[DEBUG] (BINIO) Padding bits removed, new buffer_len = %d\n", bstream->buffer_len);
-                    if (bstream->buffer_len == 0)
-                    {
-                        return EOF;
-                    }
-                }
+                break;
             }
         }
-    }
 
-    bstream->bit_pos--;
-    if (bstream->bit_pos == (7 - bstream->buffer_len))
-    {
-        return EOF;
+        unsigned int n = nbits - skipped;
+        if (n > bstream->acc_len)
+        {
+            n = bstream->acc_len;
+        }
+        // Two shifts since a shift by 64 is undefined
+        bstream->acc <<= n / 2;
+        bstream->acc <<= n - n / 2;
+        bstream->acc_len -= n;
+        skipped += n;
     }
-    int bit = (bstream->buffer >> bstream->bit_pos) & 1;
-    return bit;
+
+    return skipped;
 }
 
 /**
@@ -304,25 +1252,99 @@ int bgetbit(BFILE *bstream)
 void bputbit(uchar b, BFILE *bstream)
 {
     DEBUG_PRINT("[DEBUG] (BINIO) bputbit(%d, %p)\n", b, bstream);
+    bputbits(b & 1, 1, bstream);
+}
 
-    if (bstream == NULL || bstream->file == NULL)
+/**
+ * @brief Writes several bits in the stream. The nbits weakest bits of value are
+ * appended to the 64-bit accumulator, the most significant one first, and every
+ * completed byte is moved to the output buffer with a single word store. The
+ * buffer is handed to the file, or grown in memory, once full.
+ * @param value The bits to write.
+ * @param nbits The number of bits to write. Values above BINIO_MAX_BITS are
+ *              split in two calls.
+ * @param bstream The descriptor of the stream.
+ */
+void bputbits(uint64_t value, unsigned int nbits, BFILE *bstream)
+{
+    if (bstream == NULL || bstream->obuf == NULL || nbits == 0)
     {
         return;
     }
 
-    if (bstream->bit_pos == 0)
+    if (nbits > BINIO_MAX_BITS)
+    {
+        if (nbits > 64)
+        {
+            nbits = 64;
+        }
+        bputbits(value >> 32, nbits - 32, bstream);
+        value &= 0xFFFFFFFFu;
+        nbits = 32;
+    }
+
+    bputbits_fast(value, nbits, bstream);
+}
+
+/**
+ * @brief Writes an array of variable-length codes in the stream. Code i is made
+ * of the lens[i] weakest bits of codes[i], written the most significant first,
+ * exactly as bputbits(codes[i], lens[i], bstream) would. The accumulator stays
+ * in registers for the whole array and the output buffer room is only checked
+ * once per run of codes, so the inner loop has no branch.
+ * @param bstream The descriptor of the stream.
+ * @param codes The codes to write.
+ * @param lens The lengths in bits of the codes, each between 0 and 32.
+ * @param n The number of codes to write.
+ * @return The number of bits written.
+ */
+uint64_t bwrite_codes(BFILE *bstream, const uint32_t *codes, const uint8_t *lens, size_t n)
+{
+    if (bstream == NULL || bstream->obuf == NULL || codes == NULL || lens == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t acc = bstream->acc;
+    unsigned int acc_len = bstream->acc_len;
+    uint64_t nbits = 0;
+    size_t i = 0;
+
+    while (i < n)
     {
-        bstream->bit_pos = 8;
-        if (bstream->buffer_len == 8)
+        // A code completes at most 4 bytes
+        size_t room = (bstream->obuf_cap - bstream->obuf_pos) / 4;
+        if (room == 0)
+        {
+            bflush(bstream);
+            continue;
+        }
+        size_t end = (n - i < room) ? n : i + room;
+
+        uchar *out = bstream->obuf;
+        size_t pos = bstream->obuf_pos;
+        for (; i < end; i++)
         {
-            fputc(bstream->buffer, bstream->file);
-            bstream->buffer = 0;
-            bstream->buffer_len = 0;
+            unsigned int len = lens[i];
+            // Left-align the code, which also drops any bit above len
+            uint64_t code = ((uint64_t)codes[i] << 32) << (32 - len);
+            acc |= code >> acc_len;
+            acc_len += len;
+            nbits += len;
+            bstore_be64(out + pos, acc);
+            pos += acc_len >> 3;
+            acc <<= acc_len & ~7u;
+            acc_len &= 7;
         }
+        bstream->obuf_pos = pos;
+    }
+
+    bstream->acc = acc;
+    bstream->acc_len = acc_len;
+    if (bstream->obuf_pos >= bstream->obuf_cap)
+    {
+        bflush(bstream);
     }
 
-    bstream->bit_pos--;
-    bstream->buffer |= ((b & 1) << bstream->bit_pos);
-    bstream->buffer_len++;
-    DEBUG_PRINT("[DEBUG] (BINIO) \t bstream->buffer  = %d (0x%X)\n", bstream->buffer, bstream->buffer);
+    return nbits;
 }
\ No newline at end of file
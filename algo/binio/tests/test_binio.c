@@ -26,10 +26,11 @@
  */
 
 
-#include "../include/binio.h"
+#include "../include/binio_inline.h"
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 /**
  * @brief Test the bopen function.
@@ -66,6 +67,30 @@ void test_bopen() {
     assert(bfile->padding == 1);
     bclose(bfile);
 
+    // Empty file: nothing to map, falls back on stdio
+    bclose(bopen("test_bopen.bin", 'w', 0));
+    bfile = bopen("test_bopen.bin", 'm', 1);
+    assert(bfile != NULL);
+    assert(bfile->file != NULL);
+    assert(bfile->mode == 'm');
+    assert(bfile->backend == BINIO_BACKEND_FILE);
+    bclose(bfile);
+
+    bfile = bopen("test_bopen.bin", 'w', 1);
+    bputbit(1, bfile);
+    bclose(bfile);
+
+    bfile = bopen("test_bopen.bin", 'm', 1);
+    assert(bfile != NULL);
+    assert(bfile->file == NULL);
+    assert(bfile->mode == 'm');
+    assert(bfile->backend == BINIO_BACKEND_MMAP);
+    assert(bgetbit(bfile) == 1);
+    assert(bgetbit(bfile) == EOF);
+    bclose(bfile);
+
+    assert(bopen("test_bopen_missing.bin", 'm', 0) == NULL);
+
     printf("All open tests passed successfully.\n");
 
     remove("test_bopen.bin");
@@ -86,6 +111,98 @@ void test_bclose() {
     printf("All close tests passed successfully.\n");
 }
 
+/**
+ * @brief Test the bopen_mem and bopen_membuf functions.
+ * Memory-backed streams should hold the same bytes as file-backed ones.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bopen_mem() {
+    uchar *buf = NULL;
+    size_t size = 0;
+    BFILE *mem = bopen_membuf(&buf, &size, 1);
+    BFILE *bfile = bopen("test_bopen_mem.bin", 'w', 1);
+    assert(mem != NULL && bfile != NULL);
+    assert(mem->file == NULL);
+    assert(mem->backend == BINIO_BACKEND_MEM);
+
+    uint64_t seed = 42;
+    for (unsigned int i = 0; i < 100000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        bputbits(seed, 1 + i % 57, mem);
+        bputbits(seed, 1 + i % 57, bfile);
+    }
+    assert(bclose(mem) == 0);
+    bclose(bfile);
+
+    FILE *f = fopen("test_bopen_mem.bin", "rb");
+    assert(f != NULL);
+    for (size_t i = 0; i < size; i++) {
+        assert(fgetc(f) == buf[i]);
+    }
+    assert(fgetc(f) == EOF);
+    fclose(f);
+
+    mem = bopen_mem(buf, size, 1);
+    assert(mem != NULL);
+    assert(mem->mode == 'r');
+    seed = 42;
+    for (unsigned int i = 0; i < 100000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        for (int j = i % 57; j >= 0; j--) {
+            assert(bgetbit(mem) == (int)((seed >> j) & 1));
+        }
+    }
+    assert(bgetbit(mem) == EOF);
+    bclose(mem);
+
+    // A caller buffer is reused and grown
+    size = 16;
+    buf = (uchar *)realloc(buf, size);
+    mem = bopen_membuf(&buf, &size, 0);
+    bputbits(0xABCD, 16, mem);
+    bclose(mem);
+    assert(size == 2);
+    assert(buf[0] == 0xAB && buf[1] == 0xCD);
+    free(buf);
+
+    remove("test_bopen_mem.bin");
+    printf("All memory open tests passed successfully.\n");
+}
+
+/**
+ * @brief Test the bopen_fd function.
+ * Streams over pipes should read and write like file streams.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bopen_fd() {
+    int fds[2];
+    assert(pipe(fds) == 0);
+
+    BFILE *out = bopen_fd(fds[1], 'w', 1);
+    assert(out != NULL);
+    for (unsigned int i = 0; i < 3000; i++) {
+        bputbits(i, 11, out);
+    }
+    assert(bclose(out) == 0);
+
+    // Not seekable: the padding must be found without fseek
+    BFILE *in = bopen_fd(fds[0], 'm', 1);
+    assert(in != NULL);
+    assert(in->backend == BINIO_BACKEND_FILE);
+    for (unsigned int i = 0; i < 3000; i++) {
+        assert(bpeek(in, 11) == (i & 0x7FF));
+        assert(bskip(in, 11) == 11);
+    }
+    assert(bgetbit(in) == EOF);
+    assert(bclose(in) == 0);
+
+    assert(bopen_fd(-1, 'r', 0) == NULL);
+
+    printf("All fd open tests passed successfully.\n");
+}
+
 /**
  * @brief Test the bgetbit function.
  * It should read individual bits from a binary file.
@@ -117,6 +234,222 @@ void test_bgetbit() {
     printf("All getbit tests passed successfully.\n");
 }
 
+/**
+ * @brief Test the bgetbit function over several blocks.
+ * The padding must be found whatever the position of the last byte
+ * relatively to the block boundaries.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bgetbit_blocks() {
+    const unsigned long sizes[] = {0, 7, 8, (unsigned long)BINIO_BUFFER_SIZE * 8 - 1, (unsigned long)BINIO_BUFFER_SIZE * 8,
+                                   (unsigned long)BINIO_BUFFER_SIZE * 16 + 3};
+
+    for (unsigned int k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        for (int padding = 0; padding <= 1; padding++) {
+            BFILE *bfile = bopen("test_bgetbit_blocks.bin", 'w', padding);
+            assert(bfile != NULL);
+            uint64_t seed = 12345 + k;
+            for (unsigned long i = 0; i < sizes[k]; i++) {
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                bputbit(seed >> 63, bfile);
+            }
+            bclose(bfile);
+
+            for (const char *mode = "rm"; *mode != '\0'; mode++) {
+                bfile = bopen("test_bgetbit_blocks.bin", *mode, padding);
+                assert(bfile != NULL);
+                seed = 12345 + k;
+                for (unsigned long i = 0; i < sizes[k]; i++) {
+                    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                    assert(bgetbit(bfile) == (int)(seed >> 63));
+                }
+                // Without padding, the stream is only completed up to the byte boundary
+                unsigned long extra = padding ? 0 : (8 - sizes[k] % 8) % 8;
+                for (unsigned long i = 0; i < extra; i++) {
+                    assert(bgetbit(bfile) == 0);
+                }
+                assert(bgetbit(bfile) == EOF);
+                bclose(bfile);
+            }
+        }
+    }
+
+    remove("test_bgetbit_blocks.bin");
+    printf("All getbit blocks tests passed successfully.\n");
+}
+
+/**
+ * @brief Test the bpeek and bskip functions.
+ * Peeking should not consume bits and should read zeros past the end.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bpeek_bskip() {
+    uchar *buf = NULL;
+    size_t size = 0;
+    BFILE *bfile = bopen_membuf(&buf, &size, 1);
+    uint64_t seed = 99;
+    for (unsigned int i = 0; i < 5000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        bputbits(seed, 1 + i % 57, bfile);
+    }
+    bputbits(0x2B, 6, bfile);
+    bclose(bfile);
+
+    bfile = bopen_mem(buf, size, 1);
+    seed = 99;
+    for (unsigned int i = 0; i < 5000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned int nbits = 1 + i % 57;
+        uint64_t expected = seed & ((1ULL << nbits) - 1);
+        assert(bpeek(bfile, nbits) == expected);
+        assert(bpeek(bfile, nbits) == expected);
+        assert(bskip(bfile, nbits) == nbits);
+    }
+
+    // 6 bits left, then zeros
+    assert(bpeek(bfile, 6) == 0x2B);
+    assert(bpeek(bfile, 12) == 0x2B << 6);
+    assert(bskip(bfile, 4) == 4);
+    assert(bpeek(bfile, 57) == 0x3ULL << 55);
+    assert(bskip(bfile, 10) == 2);
+    assert(bpeek(bfile, 8) == 0);
+    assert(bskip(bfile, 1) == 0);
+    assert(bgetbit(bfile) == EOF);
+    bclose(bfile);
+
+    // Large skips go through several refills
+    bfile = bopen_mem(buf, size, 1);
+    assert(bskip(bfile, 1000) == 1000);
+    bclose(bfile);
+    free(buf);
+
+    printf("All peek/skip tests passed successfully.\n");
+}
+
+/**
+ * @brief Test the inline fast path of binio_inline.h.
+ * Bits written inline should read back through the out-of-line functions and
+ * the other way around.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_inline_fast() {
+    uchar *buf = NULL;
+    size_t size = 0;
+    BFILE *bfile = bopen_membuf(&buf, &size, 1);
+    uint64_t seed = 7;
+    for (unsigned int i = 0; i < 20000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (i % 3 == 0) {
+            bputbit_fast(seed & 1, bfile);
+        } else {
+            bputbits_fast(seed, 1 + i % 57, bfile);
+        }
+    }
+    bclose(bfile);
+
+    bfile = bopen_mem(buf, size, 1);
+    seed = 7;
+    for (unsigned int i = 0; i < 20000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (i % 3 == 0) {
+            assert(bgetbit_fast(bfile) == (int)(seed & 1));
+        } else {
+            unsigned int nbits = 1 + i % 57;
+            uint64_t expected = seed & ((1ULL << nbits) - 1);
+            assert(bpeek_fast(bfile, nbits) == expected);
+            assert(bskip_fast(bfile, nbits) == nbits);
+        }
+    }
+    assert(bgetbit_fast(bfile) == EOF);
+    assert(bpeek_fast(bfile, 8) == 0);
+    assert(bskip_fast(bfile, 8) == 0);
+    bclose(bfile);
+
+    // Same stream through the out-of-line functions
+    bfile = bopen_mem(buf, size, 1);
+    seed = 7;
+    for (unsigned int i = 0; i < 20000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned int nbits = (i % 3 == 0) ? 1 : 1 + i % 57;
+        assert(bpeek(bfile, nbits) == (seed & ((1ULL << nbits) - 1)));
+        assert(bskip(bfile, nbits) == nbits);
+    }
+    assert(bgetbit(bfile) == EOF);
+    bclose(bfile);
+    free(buf);
+
+    printf("All inline fast path tests passed successfully.\n");
+}
+
+/**
+ * @brief Test the btell and bseek functions.
+ * Seeking to random bit offsets should give back the bits written there.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_btell_bseek() {
+    const uint64_t nbits = (uint64_t)BINIO_BUFFER_SIZE * 8 * 3 + 5;
+    BFILE *bfile = bopen("test_bseek.bin", 'w', 1);
+    assert(btell(bfile) == 0);
+    // Bit i of the stream is bit (i % 64) of the word i / 64, most significant first
+    for (uint64_t i = 0; i < nbits; i += 32) {
+        unsigned int n = (nbits - i < 32) ? nbits - i : 32;
+        uint64_t word = (i / 64) * 0x9E3779B97F4A7C15ULL;
+        bputbits((i % 64 == 0 ? word >> 32 : word) >> (32 - n), n, bfile);
+    }
+    assert(btell(bfile) == nbits);
+    bclose(bfile);
+
+    uchar *buf = NULL;
+    size_t size = 0;
+    FILE *f = fopen("test_bseek.bin", "rb");
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = (uchar *)malloc(size);
+    assert(fread(buf, 1, size, f) == size);
+    fclose(f);
+
+    const char *modes = "rmb";
+    for (const char *mode = modes; *mode != '\0'; mode++) {
+        bfile = (*mode == 'b') ? bopen_mem(buf, size, 1) : bopen("test_bseek.bin", *mode, 1);
+        assert(bfile != NULL);
+        uint64_t seed = 1;
+        for (int k = 0; k < 2000; k++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint64_t pos = (seed >> 11) % nbits;
+            assert(bseek(bfile, pos) == 0);
+            assert(btell(bfile) == pos);
+            unsigned int n = (nbits - pos < 20) ? nbits - pos : 20;
+            uint64_t expected = 0;
+            for (unsigned int j = 0; j < n; j++) {
+                uint64_t i = pos + j;
+                uint64_t word = (i / 64) * 0x9E3779B97F4A7C15ULL;
+                expected = (expected << 1) | ((word >> (63 - i % 64)) & 1);
+            }
+            assert(bpeek(bfile, n) == expected);
+            assert(bskip(bfile, n) == n);
+            assert(btell(bfile) == pos + n);
+        }
+        assert(bseek(bfile, nbits) == 0);
+        assert(bgetbit(bfile) == EOF);
+        assert(btell(bfile) == nbits);
+        assert(bseek(bfile, nbits + 1) == EOF);
+        // Past the end, away from the current block, the stream is left as it was
+        assert(bseek(bfile, 0) == 0);
+        assert(bseek(bfile, 8 * ((uint64_t)size + 100)) == EOF);
+        assert(btell(bfile) == 0);
+        bclose(bfile);
+    }
+
+    free(buf);
+    remove("test_bseek.bin");
+    printf("All tell/seek tests passed successfully.\n");
+}
+
 /**
  * @brief Test the bputbit function.
  * It should write individual bits to a binary file.
@@ -138,18 +471,253 @@ void test_bputbit() {
     bclose(bfile);
 
     // 1100 1100
-    // 1100 1___ => padding
+    // 1000 0000 => padding
 
     bfile = bopen("test_bputbit.bin", 'r', 1);
     unsigned char read_data = 0;
-    assert(bread(&read_data, 8, bfile) == 5);
-    assert(read_data == 0b00010011);  // !!! lecture a l'envers       1010 => 0101
+    assert(bread(&read_data, 8, bfile) == 8);
+    assert(read_data == 0b00110011);  // !!! lecture a l'envers       1010 => 0101
+    assert(bgetbit(bfile) == EOF);
     bclose(bfile);
 
     remove("test_bputbit.bin");
     printf("All putbit tests passed successfully.\n");
 }
 
+/**
+ * @brief Test the bputbits function.
+ * It should produce the same bytes and padding as the equivalent bputbit calls.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bputbits() {
+    const unsigned int widths[] = {1, 3, 7, 8, 13, 32, 57, 64, 5};
+    const unsigned int nwidths = sizeof(widths) / sizeof(widths[0]);
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+    BFILE *words = bopen("test_bputbits_words.bin", 'w', 1);
+    BFILE *bits = bopen("test_bputbits_bits.bin", 'w', 1);
+    assert(words != NULL && bits != NULL);
+
+    for (unsigned int i = 0; i < 20000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned int nbits = widths[i % nwidths];
+        bputbits(seed, nbits, words);
+        for (int j = nbits - 1; j >= 0; j--) {
+            bputbit((seed >> j) & 1, bits);
+        }
+    }
+    bclose(words);
+    bclose(bits);
+
+    FILE *fw = fopen("test_bputbits_words.bin", "rb");
+    FILE *fb = fopen("test_bputbits_bits.bin", "rb");
+    assert(fw != NULL && fb != NULL);
+    int cw, cb;
+    do {
+        cw = fgetc(fw);
+        cb = fgetc(fb);
+        assert(cw == cb);
+    } while (cw != EOF);
+    fclose(fw);
+    fclose(fb);
+
+    // 5 bits then the padding pattern: 1011 0100
+    BFILE *bfile = bopen("test_bputbits_words.bin", 'w', 1);
+    bputbits(0b10110, 5, bfile);
+    bclose(bfile);
+    bfile = bopen("test_bputbits_words.bin", 'r', 1);
+    unsigned char read_data = 0;
+    assert(bread(&read_data, 8, bfile) == 5);
+    assert(read_data == 0b00001101);
+    bclose(bfile);
+
+    remove("test_bputbits_words.bin");
+    remove("test_bputbits_bits.bin");
+    printf("All putbits tests passed successfully.\n");
+}
+
+/**
+ * @brief Test the bwrite_codes function.
+ * It should produce the same bytes as the equivalent bputbits calls.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bwrite_codes() {
+    const size_t n = 100000;
+    uint32_t *codes = (uint32_t *)malloc(n * sizeof(uint32_t));
+    uint8_t *lens = (uint8_t *)malloc(n);
+    assert(codes != NULL && lens != NULL);
+    uint64_t seed = 3;
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        codes[i] = seed >> 16;  // Bits above the length must be ignored
+        lens[i] = (seed >> 58) % 33;
+        total += lens[i];
+    }
+
+    uchar *buf = NULL, *ref = NULL;
+    size_t size = 0, ref_size = 0;
+    BFILE *bfile = bopen_membuf(&buf, &size, 1);
+    BFILE *bref = bopen_membuf(&ref, &ref_size, 1);
+    bputbits(0x5, 3, bfile);
+    bputbits(0x5, 3, bref);
+    assert(bwrite_codes(bfile, codes, lens, n) == total);
+    for (size_t i = 0; i < n; i++) {
+        bputbits(codes[i] & ((1ULL << lens[i]) - 1), lens[i], bref);
+    }
+    bclose(bfile);
+    bclose(bref);
+
+    assert(size == ref_size);
+    assert(memcmp(buf, ref, size) == 0);
+
+    free(buf);
+    free(ref);
+    free(codes);
+    free(lens);
+    printf("All write codes tests passed successfully.\n");
+}
+
+/**
+ * @brief Test the basync function.
+ * An asynchronous stream should write the same bytes as a synchronous one.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_basync() {
+    uchar *ref = NULL;
+    size_t ref_size = 0;
+    BFILE *bref = bopen_membuf(&ref, &ref_size, 1);
+    BFILE *bfile = bopen("test_basync.bin", 'w', 1);
+    assert(basync(bfile) == 0);
+    assert(basync(bref) == EOF);
+
+    uint64_t seed = 5;
+    for (unsigned int i = 0; i < 400000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        bputbits(seed, 1 + i % 57, bfile);
+        bputbits(seed, 1 + i % 57, bref);
+    }
+    assert(btell(bfile) == btell(bref));
+    assert(bclose(bfile) == 0);
+    bclose(bref);
+
+    FILE *f = fopen("test_basync.bin", "rb");
+    assert(f != NULL);
+    for (size_t i = 0; i < ref_size; i++) {
+        assert(fgetc(f) == ref[i]);
+    }
+    assert(fgetc(f) == EOF);
+    fclose(f);
+
+    bfile = bopen("test_basync.bin", 'r', 0);
+    assert(basync(bfile) == EOF);
+    bclose(bfile);
+
+    free(ref);
+    remove("test_basync.bin");
+    printf("All async tests passed successfully.\n");
+}
+
+/**
+ * @brief Test the bchecksum and bcrc32c functions.
+ * Checksummed streams should read back their data and detect corruptions.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bchecksum() {
+    // Reference value of the CRC32C
+    assert(bcrc32c(0, "123456789", 9) == 0xE3069283);
+    assert(bcrc32c(bcrc32c(0, "1234", 4), "56789", 5) == 0xE3069283);
+    assert(bcrc32c(0, NULL, 0) == 0);
+
+    // Data over several blocks, through a file and memory
+    BFILE *bfile = bopen("test_bchecksum.bin", 'w', 1);
+    uchar *buf = NULL;
+    size_t size = 0;
+    BFILE *bmem = bopen_membuf(&buf, &size, 1);
+    assert(bchecksum(bfile) == 0);
+    assert(bchecksum(bmem) == 0);
+    uint64_t seed = 11;
+    for (unsigned int i = 0; i < 100000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        bputbits(seed, 1 + i % 57, bfile);
+        bputbits(seed, 1 + i % 57, bmem);
+    }
+    bputbits(0x5, 3, bfile);
+    bputbits(0x5, 3, bmem);
+    assert(bclose(bfile) == 0);
+    assert(bclose(bmem) == 0);
+
+    char modes[] = {'r', 'm'};
+    for (int m = 0; m < 2; m++) {
+        bfile = bopen("test_bchecksum.bin", modes[m], 1);
+        assert(bchecksum(bfile) == 0);
+        seed = 11;
+        for (unsigned int i = 0; i < 100000; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            unsigned int nbits = 1 + i % 57;
+            assert(bpeek(bfile, nbits) == (seed & ((1ULL << nbits) - 1)));
+            assert(bskip(bfile, nbits) == nbits);
+        }
+        assert(bpeek(bfile, 3) == 0x5);
+        assert(bskip(bfile, 8) == 3);
+        assert(bgetbit(bfile) == EOF);
+        assert(bclose(bfile) == 0);
+
+        // Stopping early still checks the whole stream
+        bfile = bopen("test_bchecksum.bin", modes[m], 1);
+        assert(bchecksum(bfile) == 0);
+        assert(bskip(bfile, 1000) == 1000);
+        assert(bclose(bfile) == 0);
+    }
+
+    // Same bytes in memory, then corrupted
+    FILE *f = fopen("test_bchecksum.bin", "rb");
+    assert(f != NULL);
+    for (size_t i = 0; i < size; i++) {
+        assert(fgetc(f) == buf[i]);
+    }
+    assert(fgetc(f) == EOF);
+    fclose(f);
+
+    size_t flips[] = {0, size / 2, size - 5, size - 1};
+    for (int k = 0; k < 4; k++) {
+        buf[flips[k]] ^= 0x10;
+        bmem = bopen_mem(buf, size, 1);
+        assert(bchecksum(bmem) == 0);
+        bskip(bmem, 57);
+        assert(bclose(bmem) == EOF);
+        buf[flips[k]] ^= 0x10;
+    }
+    bmem = bopen_mem(buf, 3, 1);
+    assert(bchecksum(bmem) == 0);
+    assert(bgetbit(bmem) == EOF);
+    assert(bclose(bmem) == EOF);
+
+    // A single flipped bit of the file is detected
+    f = fopen("test_bchecksum.bin", "r+b");
+    fseek(f, 12345, SEEK_SET);
+    fputc(buf[12345] ^ 0x01, f);
+    fclose(f);
+    bfile = bopen("test_bchecksum.bin", 'r', 1);
+    assert(bchecksum(bfile) == 0);
+    assert(bclose(bfile) == EOF);
+
+    // Too late once bits went through
+    bfile = bopen("test_bchecksum.bin", 'w', 0);
+    bputbit(1, bfile);
+    assert(bchecksum(bfile) == EOF);
+    bclose(bfile);
+    assert(bchecksum(NULL) == EOF);
+
+    free(buf);
+    remove("test_bchecksum.bin");
+    printf("All checksum tests passed successfully.\n");
+}
+
 /**
  * @brief Test the bwrite function.
  * It should write bits to a binary file.
@@ -206,14 +774,93 @@ void test_bread() {
     printf("All read tests passed successfully.\n");
 }
 
+/**
+ * @brief Test the bread and bwrite functions on large payloads.
+ * Aligned and unaligned streams, with and without padding, should give
+ * back the written bits.
+ * 
+ * @return Should panic if the test fails.
+*/
+void test_bread_bwrite_bulk() {
+    const unsigned int nbits = 8 * 200000 + 5;
+    unsigned char *data = (unsigned char *)malloc(nbits / 8 + 1);
+    unsigned char *read_data = (unsigned char *)malloc(nbits / 8 + 3);
+    assert(data != NULL && read_data != NULL);
+    uint64_t seed = 7;
+    for (unsigned int i = 0; i <= nbits / 8; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[i] = seed >> 56;
+    }
+    data[nbits / 8] &= 0x1F;
+
+    for (unsigned int offset = 0; offset < 8; offset += 3) {
+        for (int padding = 0; padding <= 1; padding++) {
+            uchar *buf = NULL;
+            size_t size = 0;
+            unsigned char head = 0x5;
+            BFILE *bfile = bopen_membuf(&buf, &size, padding);
+            bwrite(&head, offset, bfile);
+            assert(bwrite(data, nbits, bfile) == nbits);
+            bclose(bfile);
+
+            // The same bits, one at a time
+            BFILE *ref = bopen("test_bread_bulk.bin", 'w', padding);
+            bwrite(&head, offset, ref);
+            for (unsigned int i = 0; i < nbits; i++) {
+                bputbit((data[i / 8] >> (i % 8)) & 1, ref);
+            }
+            bclose(ref);
+            FILE *f = fopen("test_bread_bulk.bin", "rb");
+            for (size_t i = 0; i < size; i++) {
+                assert(fgetc(f) == buf[i]);
+            }
+            assert(fgetc(f) == EOF);
+            fclose(f);
+
+            const char *modes = "rmb";
+            for (const char *mode = modes; *mode != '\0'; mode++) {
+                bfile = (*mode == 'b') ? bopen_mem(buf, size, padding) : bopen("test_bread_bulk.bin", *mode, padding);
+                head = 0;
+                assert(bread(&head, offset, bfile) == offset);
+                assert(head == (0x5 & ((1 << offset) - 1)));
+                memset(read_data, 0xFF, nbits / 8 + 3);
+                unsigned int expected = padding ? nbits : nbits + (8 - (offset + nbits) % 8) % 8;
+                assert(bread(read_data, nbits + 16, bfile) == expected);
+                assert(memcmp(read_data, data, nbits / 8 + 1) == 0);
+                assert(bgetbit(bfile) == EOF);
+                bclose(bfile);
+            }
+            free(buf);
+        }
+    }
+
+    free(data);
+    free(read_data);
+    remove("test_bread_bulk.bin");
+    printf("All bulk read/write tests passed successfully.\n");
+}
+
 /**
  * @brief Main function for the test_binio program.
 */
 int main() {
     test_bopen();
     test_bclose();
+    test_bopen_mem();
+    test_bopen_fd();
     test_bgetbit();
+    test_bgetbit_blocks();
+    test_bpeek_bskip();
+    test_inline_fast();
+    test_btell_bseek();
     test_bputbit();
+    test_bputbits();
+    test_bwrite_codes();
+    test_basync();
+    test_bchecksum();
+    test_bwrite();
+    test_bread();
+    test_bread_bwrite_bulk();
 
     printf("All tests passed successfully.\n");
     return 0;
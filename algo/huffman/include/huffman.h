@@ -12,8 +12,21 @@
 #ifndef HUFFMAN
 #define HUFFMAN
 
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of symbols of the byte alphabet
+#define HUFF_SYMBOLS 256
+
+// Longest code the format allows, so that codes fit a 32-bit word; longer
+// ones are shortened by the encoder
+#define HUFF_MAX_CODE_LEN 32
+
 void huffman_encode(char *input_file, char *output_file);
+void huffman_encode_limit(char *input_file, char *output_file, int max_len);
+int huffman_encode_buffer(const void *data, size_t size, char *output_file);
 void huffman_decode(char *input_file, char *output_file);
+int huffman_decoded_size(char *input_file, uint64_t *size);
 int huffman_file(char *filename, const char mode);
 
 #endif
\ No newline at end of file
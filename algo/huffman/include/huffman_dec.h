@@ -12,45 +12,86 @@
 #ifndef HUFFMAN_DEC
 #define HUFFMAN_DEC
 
-#include "../../binio/include/binio.h"
+#include "huffman.h"
+#include "../../binio/include/binio_inline.h"
 
 #include <stdio.h>
 
 #define HUFF_OUTPUT_FILE_DEC_SUFFIX "_HUFFdec"
-struct leaf_dec
+
+// Returned by decode_symbol() for a truncated or invalid code
+#define HUFF_INVALID -2
+
+// Bits of the first-level lookup table
+#define HUFF_TABLE_BITS 11
+// Widest second-level table; longer codes are decoded bit by bit
+#define HUFF_SUB_BITS 7
+// Room for the first-level table and the second-level tables of any complete
+// code: a table of w bits lies under at least w + 1 of the HUFF_SYMBOLS leaves
+#define HUFF_TABLE_SIZE ((1 << HUFF_TABLE_BITS) + HUFF_SYMBOLS / (HUFF_SUB_BITS + 1) * (1 << HUFF_SUB_BITS))
+
+// Entry of the lookup tables, indexed by the next bits of the stream
+struct huff_entry
 {
-    char c;
+    uint16_t value;   // Symbol, or offset of the second-level table
+    uint8_t len;      // Code length, 0 if the code is not in the tables
+    uint8_t sub_bits; // Width of the second-level table, 0 for a symbol
 };
 
-struct node_dec
+// Bits of the multi-symbol lookup table, at most HUFF_TABLE_BITS + HUFF_SUB_BITS
+#define HUFF_MULTI_BITS 12
+// Most symbols held by an entry of the multi-symbol table
+#define HUFF_MULTI_SYMBOLS 4
+// Shortest message worth building the multi-symbol table for
+#define HUFF_MULTI_AFTER 16384
+
+// Entry of the multi-symbol table: the symbols whose codes fit in its index
+struct huff_multi
 {
-    struct node_dec *l;
-    struct node_dec *r;
-    struct leaf_dec *leaf;
+    uint8_t symbol[HUFF_MULTI_SYMBOLS];
+    uint8_t count; // Number of symbols, 0 if the first code is longer than HUFF_TABLE_BITS
+    uint8_t bits;  // Total length of their codes
 };
 
-// Helper function to read a specified number of bits from a BFILE
-unsigned char read_bits(BFILE *bfile, int num_bits);
+// Canonical decoding tables, rebuilt from the code lengths
+struct huff_decoder
+{
+    int count[HUFF_MAX_CODE_LEN + 1]; // Number of codes of each length
+    uint8_t symbol[HUFF_SYMBOLS];     // Symbols in code order
+    int max_len;
+    struct huff_entry table[HUFF_TABLE_SIZE];
+    struct huff_multi multi[1 << HUFF_MULTI_BITS];
+    int multi_ready; // Whether multi is built
+};
+
+// Function to read the code lengths at the beginning of the encoded file
+int read_lengths(BFILE *bfile, uint8_t *lengths);
+
+// Function to read the header of the encoded file: the message size and the code lengths
+int read_header(BFILE *bfile, uint64_t *size, struct huff_decoder *dec);
+
+// Function to build the decoding tables from the code lengths
+int build_decoder(const uint8_t *lengths, struct huff_decoder *dec);
 
-// Helper function to create a new leaf
-struct leaf_dec *create_leaf(char c);
+// Function to build the multi-symbol table of a decoder
+void build_multi(struct huff_decoder *dec);
 
-// Helper function to create a new node
-struct node_dec *create_node(struct node_dec *left, struct node_dec *right);
+// Function to decode one symbol
+int decode_symbol(const struct huff_decoder *dec, BFILE *bfile);
 
-// Function to construct the tree from the encoded string
-struct node_dec *construct_tree(BFILE *bfile);
+// Function to decode a given number of symbols into memory
+int decode_buffer(const struct huff_decoder *dec, BFILE *bfile, uint8_t *out, size_t count);
 
-// Function to print the tree for debugging purposes
-void print_tree_dec(struct node_dec *root, int depth);
+// Function to decode the message and write it to the output file
+int decode_message(struct huff_decoder *dec, BFILE *bfile, uint64_t size, FILE *output);
 
-// Function to free the memory allocated for the tree
-void free_tree_dec(struct node_dec *root);
+// Function to decode an encoded stream as it is read
+int huff_decode_stream(BFILE *bfile, FILE *output);
 
-// Function to decode the message using the Huffman tree and write it to the output file
-void decode_message(struct node_dec *root, BFILE *bfile, FILE *output);
+// Function to read the size of the decoded message without decoding it
+int huff_decoded_size(const char *input_file, uint64_t *size);
 
-// Function to decode the input file using the Huffman tree and write the decoded output to a file
+// Function to decode the input file using the Huffman codes and write the decoded output to a file
 void huff_decode(const char *input_file, const char *output_file);
 
 #endif // HUFFMAN_DEC
@@ -12,34 +12,40 @@
 #ifndef HUFFMAN_ENC
 #define HUFFMAN_ENC
 
+#include "huffman.h"
+#include "../../binio/include/binio_inline.h"
+
 #define HUFF_OUTPUT_FILE_ENC_SUFFIX "_HUFFenc"
 struct frequency_tab
 {
-    int arr[256];
+    uint64_t arr[256];
     int size;
 };
 
-struct node
-{
-    struct node *l;
-    struct node *r;
-    struct leaf *leaf;
-    int value;
-};
+// Child index of a leaf
+#define HUFF_NO_NODE -1
 
-struct leaf
+// Node of a Huffman tree stored in a flat array, leaves first
+struct node
 {
-    char c;
-    int value;
+    int l;
+    int r;
+    int symbol;
+    uint64_t value;
 };
 
 void init_frequency_tab(struct frequency_tab *ft);
 void update_frequency_tab(struct frequency_tab *ft, const char *file);
+void byte_histogram(const uint8_t *data, size_t size, uint64_t *counts);
+void update_frequency_buffer(struct frequency_tab *ft, const uint8_t *data, size_t size);
 void print_frequency_tab(struct frequency_tab *ft);
-struct node *build_tree(struct frequency_tab *ft, struct leaf *leaves, struct node *nodes, int leaf_count);
-void generate_codes(struct node *tree, char *code, int depth, char *codes[]);
-void encode_file(const char *input_file, const char *output_file, struct node *tree, char *codes[]);
-void print_tree(struct node *n);
-void free_tree(struct node *tree);
+int build_tree(const uint64_t *freq, int nsymbols, struct node *nodes);
+void code_lengths(const struct node *nodes, int root, int max_len, uint8_t *lengths);
+void generate_codes(const uint8_t *lengths, uint32_t *codes);
+void write_lengths(const uint8_t *lengths, BFILE *output);
+void encode_buffer(const uint8_t *data, size_t size, const uint8_t *lengths, const uint32_t *codes, BFILE *output);
+int huff_encode_buffer(const uint8_t *data, size_t size, BFILE *output, int max_len);
+void print_tree(const struct node *nodes, int n);
+void huff_encode_limit(char *input_file, char *output_file, int max_len);
 void huff_encode(char *input_file, char *output_file);
 #endif
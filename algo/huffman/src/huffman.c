@@ -44,6 +44,45 @@ void huffman_encode(char *input_file, char *output_file)
     return;
 }
 
+/**
+ * @brief Encodes a file using Huffman encoding, with codes of at most max_len
+ * bits. Short limits, such as 11 or 12 bits, let the decoder find every code
+ * with a single table lookup at a small cost in compression.
+ *
+ * @param input_file Path to the input file.
+ * @param output_file Path to the output file where the encoded message will be written.
+ * @param max_len Maximal code length, between 1 and HUFF_MAX_CODE_LEN.
+ */
+void huffman_encode_limit(char *input_file, char *output_file, int max_len)
+{
+    huff_encode_limit(input_file, output_file, max_len);
+}
+
+/**
+ * @brief Encodes an in-memory buffer using Huffman encoding. The output file
+ * is the same as the one huffman_encode() writes for a file with these bytes.
+ *
+ * @param data Location of the bytes to encode.
+ * @param size Number of bytes.
+ * @param output_file Path to the output file where the encoded message will be written.
+ * @return 0 upon success, otherwise -1.
+ */
+int huffman_encode_buffer(const void *data, size_t size, char *output_file)
+{
+    BFILE *output = bopen(output_file, 'w', 1);
+    if (output == NULL)
+    {
+        perror("Error opening output file");
+        return -1;
+    }
+    int ret = huff_encode_buffer((const uint8_t *)data, size, output, HUFF_MAX_CODE_LEN);
+    if (bclose(output) != 0)
+    {
+        ret = -1;
+    }
+    return ret;
+}
+
 /**
  * @brief Decodes a file using Huffman decoding.
  *
@@ -55,6 +94,19 @@ void huffman_decode(char *input_file, char *output_file)
     huff_decode(input_file, output_file);
 }
 
+/**
+ * @brief Reads the size of the decoded message of an encoded file, which is
+ * stored in its header, without decoding it.
+ *
+ * @param input_file Path to the input file containing the encoded message.
+ * @param size Location where the number of bytes of the decoded message is stored.
+ * @return 0 upon success, otherwise -1.
+ */
+int huffman_decoded_size(char *input_file, uint64_t *size)
+{
+    return huff_decoded_size(input_file, size);
+}
+
 /**
  * @brief Main function for the Huffman algorithm.
  * This function is used to encode or decode a file using the MTF algorithm.
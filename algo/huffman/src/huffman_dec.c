@@ -28,24 +28,39 @@
 #include "huffman_dec.h"
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /**
- * @brief Reads a specified number of bits from a BFILE.
+ * @brief Reads a positive integer written with the Elias gamma code.
  *
  * @param bfile Pointer to the BFILE.
- * @param num_bits Number of bits to read.
- * @return The value read.
+ * @return The value read, 0 if the stream ends or the value is too large.
  */
-unsigned char read_bits(BFILE *bfile, int num_bits)
+static unsigned int read_gamma(BFILE *bfile)
 {
-    unsigned char value = 0;
-    for (int i = 0; i < num_bits; i++)
+    int zeros = 0;
+    int bit;
+    while ((bit = bgetbit_fast(bfile)) == 0)
+    {
+        if (++zeros > 31)
+        {
+            return 0;
+        }
+    }
+    if (bit == EOF)
     {
-        int bit = bgetbit(bfile);
+        return 0;
+    }
+
+    unsigned int value = 1;
+    for (int i = 0; i < zeros; i++)
+    {
+        bit = bgetbit_fast(bfile);
         if (bit == EOF)
         {
-            fprintf(stderr, "Error: Unexpected end of file while reading bits\n");
-            break;
+            return 0;
         }
         value = (value << 1) | bit;
     }
@@ -53,244 +68,563 @@ unsigned char read_bits(BFILE *bfile, int num_bits)
 }
 
 /**
- * @brief Creates a new leaf node.
+ * @brief Reads the code lengths written by write_lengths().
  *
- * @param c Character value of the leaf.
- * @return Pointer to the new leaf node.
+ * @param bfile Pointer to the BFILE, positioned at the beginning of the stream.
+ * @param lengths Array of HUFF_SYMBOLS code lengths to fill, 0 for unused symbols.
+ * @return The number of used symbols, or -1 if the lengths are invalid.
  */
-struct leaf_dec *create_leaf(char c)
+int read_lengths(BFILE *bfile, uint8_t *lengths)
 {
-    struct leaf_dec *new_leaf = (struct leaf_dec *)malloc(sizeof(struct leaf_dec));
-    if (!new_leaf)
+    memset(lengths, 0, HUFF_SYMBOLS);
+
+    int used = (int)read_gamma(bfile) - 1;
+    if (used < 0 || used > HUFF_SYMBOLS)
+    {
+        return -1;
+    }
+
+    int symbol = -1;
+    int len = 0;
+    for (int i = 0; i < used; i++)
     {
-        perror("Error allocating memory for leaf");
-        exit(EXIT_FAILURE);
+        unsigned int gap = read_gamma(bfile);
+        unsigned int zigzag = read_gamma(bfile);
+        if (gap == 0 || zigzag == 0 || gap > (unsigned int)(HUFF_SYMBOLS - 1 - symbol))
+        {
+            return -1;
+        }
+        symbol += gap;
+        // Even values are increases, odd ones decreases or no change
+        len += (zigzag % 2 == 0) ? (int)(zigzag / 2) : -(int)(zigzag / 2);
+        if (len < 1 || len > HUFF_MAX_CODE_LEN)
+        {
+            return -1;
+        }
+        lengths[symbol] = len;
     }
-    new_leaf->c = c;
-    return new_leaf;
+    return used;
 }
 
 /**
- * @brief Creates a new internal node.
+ * @brief Reads an unsigned integer written as a varint: 7 bits per byte, the
+ * weakest first, the top bit set on all the bytes but the last.
  *
- * @param left Pointer to the left child.
- * @param right Pointer to the right child.
- * @return Pointer to the new internal node.
+ * @param bfile Pointer to the BFILE.
+ * @param value Location where the integer is stored.
+ * @return 0 upon success, -1 if the stream ends or the integer overflows.
  */
-struct node_dec *create_node(struct node_dec *left, struct node_dec *right)
+static int read_varint(BFILE *bfile, uint64_t *value)
 {
-    struct node_dec *new_node = (struct node_dec *)malloc(sizeof(struct node_dec));
-    if (!new_node)
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
     {
-        perror("Error allocating memory for node");
-        exit(EXIT_FAILURE);
+        uint64_t byte = bpeek_fast(bfile, 8);
+        if (bskip_fast(bfile, 8) != 8 || (shift == 63 && byte > 1))
+        {
+            return -1;
+        }
+        *value |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return 0;
+        }
     }
-    new_node->l = left;
-    new_node->r = right;
-    new_node->leaf = NULL;
-    return new_node;
+    return -1;
 }
 
 /**
- * @brief Constructs the Huffman tree from the encoded string.
+ * @brief Fills the lookup table entries of a code: all the entries whose index
+ * starts with the code.
  *
- * @param bfile Pointer to the BFILE containing the encoded string.
- * @return Pointer to the root of the Huffman tree.
+ * @param table First entry of the table.
+ * @param bits Width of the table index.
+ * @param code Code, or its bits past the first-level index.
+ * @param len Number of bits of code.
+ * @param entry Entry to store.
  */
-struct node_dec *construct_tree(BFILE *bfile)
+static void fill_entries(struct huff_entry *table, int bits, uint32_t code, int len, struct huff_entry entry)
 {
-    int bit = bgetbit(bfile);
-    if (bit == EOF)
+    uint32_t first = code << (bits - len);
+    for (uint32_t i = 0; i < (1u << (bits - len)); i++)
     {
-        return NULL;
+        table[first + i] = entry;
     }
+}
 
-    if (bit == 1)
+/**
+ * @brief Builds the lookup tables of the decoder. A code of at most
+ * HUFF_TABLE_BITS bits fills the first-level entries it starts; a longer one
+ * goes to the second-level table of its first HUFF_TABLE_BITS bits, which is
+ * as wide as the longest code sharing them needs, up to HUFF_SUB_BITS.
+ *
+ * @param dec Decoder whose counts and symbols are set.
+ * @return 0 upon success, -1 if the tables do not fit.
+ */
+static int build_tables(struct huff_decoder *dec)
+{
+    // Canonical codes and their lengths, in code order
+    uint32_t codes[HUFF_SYMBOLS];
+    uint8_t lens[HUFF_SYMBOLS];
+    int n = 0;
+    uint32_t code = 0;
+    for (int len = 1; len <= dec->max_len; len++)
     {
-        char c = read_bits(bfile, 8);
-        struct leaf_dec *leaf = create_leaf(c);
-        struct node_dec *leaf_node = (struct node_dec *)malloc(sizeof(struct node_dec));
-        if (!leaf_node)
+        for (int i = 0; i < dec->count[len]; i++)
         {
-            perror("Error allocating memory for leaf node");
-            exit(EXIT_FAILURE);
+            codes[n] = code++;
+            lens[n++] = len;
         }
-        leaf_node->l = leaf_node->r = NULL;
-        leaf_node->leaf = leaf;
-        return leaf_node;
+        code <<= 1;
     }
-    else if (bit == 0)
+
+    // A complete code fills the whole first level, a lone symbol half of it
+    if (n < 2)
     {
-        struct node_dec *left = construct_tree(bfile);
-        struct node_dec *right = construct_tree(bfile);
-        return create_node(left, right);
+        memset(dec->table, 0, (1 << HUFF_TABLE_BITS) * sizeof(struct huff_entry));
     }
-    return NULL;
+    int next = 1 << HUFF_TABLE_BITS; // First free entry for a second-level table
+    int64_t last_prefix = -1;
+    for (int k = 0; k < n; k++)
+    {
+        struct huff_entry entry = {dec->symbol[k], lens[k], 0};
+        if (lens[k] <= HUFF_TABLE_BITS)
+        {
+            fill_entries(dec->table, HUFF_TABLE_BITS, codes[k], lens[k], entry);
+            continue;
+        }
+
+        int extra = lens[k] - HUFF_TABLE_BITS;
+        uint32_t prefix = codes[k] >> extra;
+        struct huff_entry *link = &dec->table[prefix];
+        if (prefix != last_prefix)
+        {
+            // Codes sharing a prefix are consecutive, the last one is the longest
+            int last = k;
+            while (last + 1 < n && (codes[last + 1] >> (lens[last + 1] - HUFF_TABLE_BITS)) == prefix)
+            {
+                last++;
+            }
+            int width = lens[last] - HUFF_TABLE_BITS;
+            if (width > HUFF_SUB_BITS)
+            {
+                width = HUFF_SUB_BITS;
+            }
+            if (next + (1 << width) > HUFF_TABLE_SIZE)
+            {
+                return -1;
+            }
+            link->value = next;
+            link->len = 0;
+            link->sub_bits = width;
+            memset(dec->table + next, 0, (1 << width) * sizeof(struct huff_entry));
+            next += 1 << width;
+            last_prefix = prefix;
+        }
+
+        // Codes too long for the second level keep a null entry
+        if (extra <= link->sub_bits)
+        {
+            uint32_t rest = codes[k] & ((1u << extra) - 1);
+            fill_entries(dec->table + link->value, link->sub_bits, rest, extra, entry);
+        }
+    }
+    return 0;
 }
 
 /**
- * @brief Prints the Huffman tree for debugging purposes.
+ * @brief Builds the multi-symbol table from the first-level table: an index
+ * holds the symbols whose codes follow each other from its first bit, as many
+ * as fit in HUFF_MULTI_BITS bits, up to HUFF_MULTI_SYMBOLS. If no two codes
+ * fit, as with nearly random data, the table is left unbuilt and the decoder
+ * keeps to single lookups.
  *
- * @param root Pointer to the root of the Huffman tree.
- * @param depth Current depth in the tree.
+ * @param dec Decoder built from the code lengths.
  */
-void print_tree_dec(struct node_dec *root, int depth)
+void build_multi(struct huff_decoder *dec)
 {
-    if (root == NULL)
+    // Two codes fit in an index only if the shortest one fits in half of it
+    int shortest = 1;
+    while (shortest <= dec->max_len && dec->count[shortest] == 0)
+    {
+        shortest++;
+    }
+    if (2 * shortest > HUFF_MULTI_BITS)
+    {
         return;
-    for (int i = 0; i < depth; i++)
+    }
+
+    memset(dec->multi, 0, sizeof(dec->multi));
+    for (uint32_t i = 0; i < (1u << HUFF_MULTI_BITS); i++)
+    {
+        struct huff_multi *multi = &dec->multi[i];
+        while (multi->count < HUFF_MULTI_SYMBOLS)
+        {
+            // Bits past the index are 0, the code must end before them
+            uint32_t rest = (i << multi->bits) & ((1u << HUFF_MULTI_BITS) - 1);
+            struct huff_entry entry = dec->table[rest >> (HUFF_MULTI_BITS - HUFF_TABLE_BITS)];
+            if (entry.len == 0 || entry.sub_bits != 0 || multi->bits + entry.len > HUFF_MULTI_BITS)
+            {
+                break;
+            }
+            multi->symbol[multi->count++] = (uint8_t)entry.value;
+            multi->bits += entry.len;
+        }
+    }
+    dec->multi_ready = 1;
+}
+
+/**
+ * @brief Builds the canonical decoding tables from the code lengths: the
+ * number of codes of each length, the symbols in code order and the lookup
+ * tables.
+ *
+ * @param lengths Array of HUFF_SYMBOLS code lengths, 0 for unused symbols.
+ * @param dec Decoder to fill.
+ * @return 0 upon success, -1 if the lengths do not form a complete prefix
+ *         code (a lone symbol excepted).
+ */
+int build_decoder(const uint8_t *lengths, struct huff_decoder *dec)
+{
+    memset(dec->count, 0, sizeof(dec->count));
+    dec->max_len = 0;
+    for (int s = 0; s < HUFF_SYMBOLS; s++)
+    {
+        dec->count[lengths[s]]++;
+        if (lengths[s] > dec->max_len)
+        {
+            dec->max_len = lengths[s];
+        }
+    }
+    int used = HUFF_SYMBOLS - dec->count[0];
+    dec->count[0] = 0;
+
+    // Codes left at each length; none may be handed out twice
+    int64_t left = 1;
+    int offset[HUFF_MAX_CODE_LEN + 2];
+    offset[1] = 0;
+    for (int len = 1; len <= HUFF_MAX_CODE_LEN; len++)
     {
-        printf("  ");
+        left = 2 * left - dec->count[len];
+        if (left < 0)
+        {
+            return -1;
+        }
+        offset[len + 1] = offset[len] + dec->count[len];
     }
-    if (root->leaf != NULL)
+    // The encoder leaves no code unused, so the second-level tables are bounded
+    if (left != 0 && used > 1)
     {
-        printf("Leaf: %c\n", root->leaf->c);
+        return -1;
     }
-    else
+
+    for (int s = 0; s < HUFF_SYMBOLS; s++)
     {
-        printf("Node\n");
-        print_tree_dec(root->l, depth + 1);
-        print_tree_dec(root->r, depth + 1);
+        if (lengths[s] != 0)
+        {
+            dec->symbol[offset[lengths[s]]++] = s;
+        }
     }
+    // The multi-symbol table is only built for long messages
+    dec->multi_ready = 0;
+    return build_tables(dec);
 }
 
 /**
- * @brief Frees the memory allocated for the Huffman tree.
+ * @brief Reads the header written by the encoder, the size of the message
+ * then the code lengths, and builds the decoder.
  *
- * @param root Pointer to the root of the Huffman tree.
+ * @param bfile Pointer to the BFILE, positioned at the beginning of the stream.
+ * @param size Location where the number of symbols of the message is stored.
+ * @param dec Decoder to build.
+ * @return 0 upon success, -1 if the header is invalid.
  */
-void free_tree_dec(struct node_dec *root)
+int read_header(BFILE *bfile, uint64_t *size, struct huff_decoder *dec)
 {
-    if (root == NULL)
-        return;
-    free_tree_dec(root->l);
-    free_tree_dec(root->r);
-    if (root->leaf != NULL)
+    uint8_t lengths[HUFF_SYMBOLS];
+    if (read_varint(bfile, size) != 0 || read_lengths(bfile, lengths) < 0 || build_decoder(lengths, dec) != 0)
     {
-        free(root->leaf);
+        return -1;
     }
-    free(root);
+    // A message needs at least one code
+    return (*size > 0 && dec->max_len == 0) ? -1 : 0;
 }
 
 /**
- * @brief Decodes the message using the Huffman tree and writes it to the output file.
+ * @brief Decodes one symbol, one bit at a time. At each length, the canonical
+ * codes form a range of consecutive integers, so the code read so far is a
+ * whole code if it falls in the range of its length.
  *
- * @param root Pointer to the root of the Huffman tree.
+ * @param dec Decoder built from the code lengths.
  * @param bfile Pointer to the BFILE containing the encoded message.
- * @param output Pointer to the output file.
+ * @return The symbol, EOF at the end of the message, or HUFF_INVALID if the
+ *         stream ends inside a code or holds no valid code.
  */
-void decode_message(struct node_dec *root, BFILE *bfile, FILE *output)
+int decode_symbol(const struct huff_decoder *dec, BFILE *bfile)
 {
-    // Read the entire bitstream into a buffer
-    int bit;
-    int buffer_size = 1024;
-    unsigned char *buffer = (unsigned char *)calloc(buffer_size, sizeof(unsigned char));
-    if (!buffer)
+    int64_t code = 0;  // Bits read so far
+    int64_t first = 0; // First code of the current length
+    int index = 0;     // Index in dec->symbol of the first code of the current length
+    for (int len = 1;; len++)
     {
-        perror("Error allocating memory for buffer");
-        exit(EXIT_FAILURE);
+        int bit = bgetbit_fast(bfile);
+        if (bit == EOF)
+        {
+            return (len == 1) ? EOF : HUFF_INVALID;
+        }
+        if (len > dec->max_len)
+        {
+            return HUFF_INVALID;
+        }
+
+        code |= bit;
+        int count = dec->count[len];
+        if (code - first < count)
+        {
+            return dec->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
     }
-    int bit_count = 0;
+}
 
-    while ((bit = bgetbit(bfile)) != EOF)
+/**
+ * @brief Decodes one symbol with the lookup tables; only codes too long for
+ * them are decoded bit by bit.
+ *
+ * @param dec Decoder built from the code lengths.
+ * @param bits The next HUFF_TABLE_BITS + HUFF_SUB_BITS bits of the stream.
+ * @param bfile Pointer to the BFILE containing the encoded message.
+ * @return The symbol, EOF at the end of the message, or HUFF_INVALID.
+ */
+static inline int decode_lookup(const struct huff_decoder *dec, uint64_t bits, BFILE *bfile)
+{
+    struct huff_entry entry = dec->table[bits >> HUFF_SUB_BITS];
+    if (entry.sub_bits != 0)
+    {
+        uint32_t rest = (uint32_t)bits & ((1u << HUFF_SUB_BITS) - 1);
+        entry = dec->table[entry.value + (rest >> (HUFF_SUB_BITS - entry.sub_bits))];
+    }
+    if (entry.len == 0)
     {
-        if (bit_count >= buffer_size * 8)
+        return decode_symbol(dec, bfile);
+    }
+
+    // Past the end, the bits read as 0 and are not consumed
+    unsigned int skipped = bskip_fast(bfile, entry.len);
+    if (skipped != entry.len)
+    {
+        return (skipped == 0) ? EOF : HUFF_INVALID;
+    }
+    return entry.value;
+}
+
+/**
+ * @brief Decodes count symbols into memory. As the number of symbols is
+ * known, there is no end of stream to look for: while at least
+ * HUFF_MULTI_SYMBOLS symbols are left, a lookup in the multi-symbol table
+ * (if built) gives all the codes starting in the next HUFF_MULTI_BITS bits,
+ * and a truncated stream is only detected once these lookups are done. The
+ * last symbols are decoded one at a time and checked each.
+ *
+ * @param dec Decoder built from the code lengths.
+ * @param bfile Pointer to the BFILE containing the encoded message.
+ * @param out Location of at least count bytes.
+ * @param count Number of symbols to decode.
+ * @return 0 upon success, -1 if the stream ends early or holds an invalid code.
+ */
+int decode_buffer(const struct huff_decoder *dec, BFILE *bfile, uint8_t *out, size_t count)
+{
+    size_t n = 0;
+    if (dec->multi_ready)
+    {
+        // Bits the stream ran out of; past the end, the bits read as 0
+        unsigned int missing = 0;
+        while (count - n >= HUFF_MULTI_SYMBOLS)
         {
-            buffer_size *= 2;
-            buffer = (unsigned char *)realloc(buffer, buffer_size);
-            if (!buffer)
+            uint64_t bits = bpeek_fast(bfile, HUFF_TABLE_BITS + HUFF_SUB_BITS);
+            const struct huff_multi *multi = &dec->multi[bits >> (HUFF_TABLE_BITS + HUFF_SUB_BITS - HUFF_MULTI_BITS)];
+            if (multi->count != 0)
             {
-                perror("Error reallocating memory for buffer");
-                exit(EXIT_FAILURE);
+                memcpy(out + n, multi->symbol, HUFF_MULTI_SYMBOLS);
+                n += multi->count;
+                missing |= multi->bits - bskip_fast(bfile, multi->bits);
+                continue;
             }
+            int symbol = decode_lookup(dec, bits, bfile);
+            if (symbol < 0)
+            {
+                return -1;
+            }
+            out[n++] = (uint8_t)symbol;
         }
-        if (bit)
-        {
-            buffer[bit_count / 8] |= (1 << (7 - (bit_count % 8)));
-        }
-        else
+        if (missing != 0)
         {
-            buffer[bit_count / 8] &= ~(1 << (7 - (bit_count % 8)));
+            return -1;
         }
-        bit_count++;
     }
 
-    // Find the position of the last '1' bit (which starts the padding)
-    int last_one_position = -1;
-    for (int i = bit_count; i >= 0; i--)
+    while (n < count)
     {
-        if ((buffer[i / 8] & (1 << (7 - (i % 8)))) != 0)
+        int symbol = decode_lookup(dec, bpeek_fast(bfile, HUFF_TABLE_BITS + HUFF_SUB_BITS), bfile);
+        if (symbol < 0)
         {
-            last_one_position = i;
-            break;
+            return -1;
         }
+        out[n++] = (uint8_t)symbol;
     }
+    return 0;
+}
 
-    // printf("Buffer content (in bits):\n");
-    // for (int i = 0; i < bit_count; i++)
-    // {
-    //     int byte_index = i / 8;
-    //     int bit_index = 7 - (i % 8);
-    //     int bit_value = (buffer[byte_index] >> bit_index) & 1;
-    //     printf("%d", bit_value);
-    //     if ((i + 1) % 8 == 0)
-    //     {
-    //         printf(" "); // Add space for better readability
-    //     }
-    // }
-    // printf("\n");
-
-    if (last_one_position == -1)
-    {
-        fprintf(stderr, "Invalid padding in the bitstream\n");
-        free(buffer);
-        return;
+/**
+ * @brief Decodes the message and writes it to the output file, one block at
+ * a time. The message must end with the stream.
+ *
+ * @param dec Decoder built from the code lengths. Its multi-symbol table is
+ *            built if the message is long enough.
+ * @param bfile Pointer to the BFILE containing the encoded message.
+ * @param size Number of symbols of the message.
+ * @param output Pointer to the output file.
+ * @return 0 upon success, -1 if the stream does not hold exactly size symbols
+ *         or the output cannot be written.
+ */
+int decode_message(struct huff_decoder *dec, BFILE *bfile, uint64_t size, FILE *output)
+{
+    if (size >= HUFF_MULTI_AFTER && !dec->multi_ready)
+    {
+        build_multi(dec);
     }
 
-    // Decode the buffer up to the last '1' bit
-    struct node_dec *current = root;
-    for (int i = 0; i <= last_one_position; i++)
+    uint8_t block[65536];
+    while (size > 0)
     {
-        bit = (buffer[i / 8] & (1 << (7 - (i % 8)))) != 0;
-        if (bit == 0)
+        size_t n = (size < sizeof(block)) ? (size_t)size : sizeof(block);
+        if (decode_buffer(dec, bfile, block, n) != 0)
         {
-            current = current->l;
+            fprintf(stderr, "Invalid code in the bitstream\n");
+            return -1;
         }
-        else if (bit == 1)
+        if (fwrite(block, 1, n, output) != n)
         {
-            current = current->r;
+            perror("Error writing output file");
+            return -1;
         }
+        size -= n;
+    }
+
+    if (bgetbit_fast(bfile) != EOF)
+    {
+        fprintf(stderr, "Unexpected data after the message\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Decodes an encoded stream and writes the message to the output file.
+ *
+ * @param bfile Stream just opened for reading with padding. It is closed.
+ * @param output Pointer to the output file.
+ * @param max_size Largest message size the stream can hold.
+ * @param prealloc Whether to reserve the room of the message in the output
+ *                 file before decoding it.
+ * @return 0 upon success, otherwise -1.
+ */
+static int decode_stream(BFILE *bfile, FILE *output, uint64_t max_size, int prealloc)
+{
+    // The checksum trailer is held back by the stream and verified on close
+    if (bchecksum(bfile) != 0)
+    {
+        fprintf(stderr, "Cannot verify the checksum of a stream already read\n");
+        bclose(bfile);
+        return -1;
+    }
 
-        if (current->leaf != NULL)
+    uint64_t size;
+    struct huff_decoder dec;
+    if (read_header(bfile, &size, &dec) != 0 || size > max_size)
+    {
+        fprintf(stderr, "Invalid Huffman header\n");
+        bclose(bfile);
+        return -1;
+    }
+    if (prealloc && size > 0)
+    {
+        // Best effort, for less fragmented output files
+        posix_fallocate(fileno(output), 0, (off_t)size);
+    }
+
+    int ret = decode_message(&dec, bfile, size, output);
+    if (ret != 0 && prealloc && fflush(output) == 0)
+    {
+        // Drop the room reserved past the decoded part
+        if (ftruncate(fileno(output), ftello(output)) != 0)
         {
-            fputc(current->leaf->c, output);
-            current = root; // Go back to the root for the next character
+            perror("Error truncating output file");
         }
     }
+    if (bclose(bfile) != 0)
+    {
+        fprintf(stderr, "Corrupted input file: checksum mismatch\n");
+        ret = -1;
+    }
+    return ret;
+}
 
-    free(buffer);
+/**
+ * @brief Decodes an encoded stream as it is read. Only the block buffers of
+ * the stream and of the output are used, whatever the size of the message.
+ *
+ * @param bfile Stream just opened for reading with padding, from a file, a
+ *              pipe or memory. It is closed.
+ * @param output Pointer to the output file.
+ * @return 0 upon success, otherwise -1.
+ */
+int huff_decode_stream(BFILE *bfile, FILE *output)
+{
+    return decode_stream(bfile, output, UINT64_MAX, 0);
 }
 
 /**
- * @brief Decodes the encoded file.
+ * @brief Reads the size of the decoded message from the header of an encoded
+ * file, without decoding anything.
  *
- * @param input_file Path to the input file containing the encoded message.
- * @param output_file Path to the output file where the decoded message will be written.
+ * @param input_file Path to the encoded file.
+ * @param size Location where the number of bytes of the message is stored.
+ * @return 0 upon success, otherwise -1.
  */
-void huff_decode(const char *input_file, const char *output_file)
+int huff_decoded_size(const char *input_file, uint64_t *size)
 {
+    // The size comes first, before any padding or checksum matters
     BFILE *bfile = bopen(input_file, 'r', 0);
     if (!bfile)
     {
-        perror("Error opening input file");
-        return;
+        return -1;
     }
+    int ret = read_varint(bfile, size);
+    bclose(bfile);
+    return ret;
+}
 
-    struct node_dec *root = construct_tree(bfile);
-    if (root == NULL)
+/**
+ * @brief Decodes the encoded file.
+ *
+ * @param input_file Path to the input file containing the encoded message.
+ * @param output_file Path to the output file where the decoded message will be written.
+ */
+void huff_decode(const char *input_file, const char *output_file)
+{
+    // Fixed-size blocks; the padding marks the end of the last code
+    BFILE *bfile = bopen(input_file, 'r', 1);
+    struct stat st;
+    if (!bfile || stat(input_file, &st) != 0)
     {
-        fprintf(stderr, "Failed to construct Huffman tree\n");
-        bclose(bfile);
+        perror("Error opening input file");
+        if (bfile)
+        {
+            bclose(bfile);
+        }
         return;
     }
 
@@ -298,15 +632,15 @@ void huff_decode(const char *input_file, const char *output_file)
     if (!output)
     {
         perror("Error opening output file");
-        free_tree_dec(root);
         bclose(bfile);
         return;
     }
 
-    decode_message(root, bfile, output);
-
-    // print_tree_dec(root, 0);
-    free_tree_dec(root);
-    bclose(bfile);
-    fclose(output);
+    // Every symbol takes at least one bit
+    decode_stream(bfile, output, 8 * (uint64_t)st.st_size, 1);
+    // Buffered data only reaches the file here
+    if (fclose(output) != 0)
+    {
+        perror("Error writing output file");
+    }
 }
@@ -26,10 +26,24 @@
  */
 
 #include "huffman_enc.h"
-#include "../../binio/include/binio.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Interleaved counter banks of the histogram, one per byte of a word
+#define HIST_BANKS 8
+// Bytes counted by the 32-bit banks before they are added to the 64-bit counts
+#define HIST_CHUNK ((size_t)1 << 30)
+// Smallest part of the input worth a thread of its own
+#define HIST_THREAD_MIN ((size_t)1 << 22)
+#define HIST_MAX_THREADS 8
 
 /**
  * @brief Initializes the frequency table with zeros.
@@ -61,15 +75,160 @@ void update_frequency_tab(struct frequency_tab *ft, const char *file)
         return;
     }
 
-    int chr;
-    while ((chr = fgetc(f)) != EOF)
+    uint8_t block[65536];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), f)) > 0)
     {
-        ft->arr[(unsigned char)chr]++; // Ensure correct indexing
+        update_frequency_buffer(ft, block, n);
     }
 
     fclose(f);
 }
 
+/**
+ * @brief Counts the bytes of a buffer in HIST_BANKS banks of counters. Each
+ * byte of a word has its own bank, so runs of the same byte do not wait on
+ * each other's increment of a single counter.
+ *
+ * @param data Location of the bytes.
+ * @param size Number of bytes.
+ * @param counts Array of HUFF_SYMBOLS counts, to which the bytes are added.
+ */
+static void histogram_banks(const uint8_t *data, size_t size, uint64_t *counts)
+{
+    uint32_t banks[HIST_BANKS][HUFF_SYMBOLS];
+
+    while (size > 0)
+    {
+        size_t n = size < HIST_CHUNK ? size : HIST_CHUNK;
+        memset(banks, 0, sizeof(banks));
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            uint64_t w;
+            memcpy(&w, data + i, sizeof(w));
+            banks[0][w & 0xFF]++;
+            banks[1][(w >> 8) & 0xFF]++;
+            banks[2][(w >> 16) & 0xFF]++;
+            banks[3][(w >> 24) & 0xFF]++;
+            banks[4][(w >> 32) & 0xFF]++;
+            banks[5][(w >> 40) & 0xFF]++;
+            banks[6][(w >> 48) & 0xFF]++;
+            banks[7][w >> 56]++;
+        }
+        for (; i < n; i++)
+        {
+            banks[0][data[i]]++;
+        }
+
+        for (int c = 0; c < HUFF_SYMBOLS; c++)
+        {
+            uint64_t sum = 0;
+            for (int b = 0; b < HIST_BANKS; b++)
+            {
+                sum += banks[b][c];
+            }
+            counts[c] += sum;
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+struct histogram_job
+{
+    const uint8_t *data;
+    size_t size;
+    uint64_t counts[HUFF_SYMBOLS];
+};
+
+static void *histogram_thread(void *arg)
+{
+    struct histogram_job *job = (struct histogram_job *)arg;
+    histogram_banks(job->data, job->size, job->counts);
+    return NULL;
+}
+
+/**
+ * @brief Counts the occurrences of every byte value in a buffer. Large buffers
+ * are split between up to HIST_MAX_THREADS threads.
+ *
+ * @param data Location of the bytes.
+ * @param size Number of bytes.
+ * @param counts Array of HUFF_SYMBOLS counts, overwritten with the result.
+ */
+void byte_histogram(const uint8_t *data, size_t size, uint64_t *counts)
+{
+    memset(counts, 0, HUFF_SYMBOLS * sizeof(uint64_t));
+
+    size_t nthreads = size / HIST_THREAD_MIN;
+    // Small inputs are counted by this thread without asking for the CPU count
+    if (nthreads > 1)
+    {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpus > 0 && nthreads > (size_t)ncpus)
+        {
+            nthreads = (size_t)ncpus;
+        }
+    }
+    if (nthreads > HIST_MAX_THREADS)
+    {
+        nthreads = HIST_MAX_THREADS;
+    }
+    if (nthreads <= 1)
+    {
+        histogram_banks(data, size, counts);
+        return;
+    }
+
+    struct histogram_job jobs[HIST_MAX_THREADS];
+    pthread_t threads[HIST_MAX_THREADS];
+    int started[HIST_MAX_THREADS];
+    size_t part = size / nthreads;
+    for (size_t t = 0; t < nthreads; t++)
+    {
+        jobs[t].data = data + t * part;
+        jobs[t].size = (t == nthreads - 1) ? size - t * part : part;
+        memset(jobs[t].counts, 0, sizeof(jobs[t].counts));
+        // The first part is counted by this thread, as are the parts whose thread fails to start
+        started[t] = t > 0 && pthread_create(&threads[t], NULL, histogram_thread, &jobs[t]) == 0;
+    }
+
+    for (size_t t = 0; t < nthreads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(threads[t], NULL);
+        }
+        else
+        {
+            histogram_thread(&jobs[t]);
+        }
+        for (int c = 0; c < HUFF_SYMBOLS; c++)
+        {
+            counts[c] += jobs[t].counts[c];
+        }
+    }
+}
+
+/**
+ * @brief Updates the frequency table with the bytes of a buffer.
+ *
+ * @param ft Pointer to the frequency table.
+ * @param data Location of the bytes.
+ * @param size Number of bytes.
+ */
+void update_frequency_buffer(struct frequency_tab *ft, const uint8_t *data, size_t size)
+{
+    uint64_t counts[HUFF_SYMBOLS];
+    byte_histogram(data, size, counts);
+    for (int c = 0; c < HUFF_SYMBOLS; c++)
+    {
+        ft->arr[c] += counts[c];
+    }
+}
+
 /**
  * @brief Prints the contents of the frequency table.
  *
@@ -81,271 +240,600 @@ void print_frequency_tab(struct frequency_tab *ft)
     {
         if (ft->arr[i] > 0)
         {
-            printf("%c -> %d\n", i, ft->arr[i]);
+            printf("%c -> %" PRIu64 "\n", i, ft->arr[i]);
         }
     }
 }
 
 /**
- * @brief Sorts an array of nodes based on their values.
+ * @brief Sorts leaves by increasing value. LSD radix sort, 8 bits per pass and
+ * only as many passes as the largest value needs; being stable, it keeps equal
+ * values in symbol order.
  *
- * @param nodes Array of nodes.
- * @param count Number of nodes in the array.
+ * @param nodes Array of leaves.
+ * @param tmp Scratch array of at least count nodes.
+ * @param count Number of leaves.
  */
-void sort_nodes(struct node nodes[], int count)
+static void sort_leaves(struct node *nodes, struct node *tmp, int count)
 {
-    for (int i = 0; i < count - 1; i++)
+    uint64_t max = 0;
+    for (int i = 0; i < count; i++)
+    {
+        max |= nodes[i].value;
+    }
+
+    struct node *src = nodes;
+    struct node *dst = tmp;
+    for (int shift = 0; shift < 64 && (max >> shift) != 0; shift += 8)
     {
-        for (int j = 0; j < count - i - 1; j++)
+        int start[257] = {0};
+        for (int i = 0; i < count; i++)
         {
-            if (nodes[j].value > nodes[j + 1].value)
-            {
-                struct node temp = nodes[j];
-                nodes[j] = nodes[j + 1];
-                nodes[j + 1] = temp;
-            }
+            start[((src[i].value >> shift) & 0xFF) + 1]++;
         }
+        for (int d = 0; d < 256; d++)
+        {
+            start[d + 1] += start[d];
+        }
+        for (int i = 0; i < count; i++)
+        {
+            dst[start[(src[i].value >> shift) & 0xFF]++] = src[i];
+        }
+
+        struct node *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != nodes)
+    {
+        memcpy(nodes, src, count * sizeof(struct node));
     }
 }
 
 /**
  * @brief Prints the Huffman tree.
  *
- * @param n Pointer to the root of the tree.
+ * @param nodes Flat array of the tree.
+ * @param n Index of the node to print.
  */
-void print_tree(struct node *n)
+void print_tree(const struct node *nodes, int n)
 {
-    if (n == NULL)
+    if (n == HUFF_NO_NODE)
         return;
-    if (n->leaf != NULL)
+    if (nodes[n].l == HUFF_NO_NODE)
     {
-        printf("Leaf: %c, Frequency: %d\n", n->leaf->c, n->leaf->value);
+        printf("Leaf: %c, Frequency: %" PRIu64 "\n", nodes[n].symbol, nodes[n].value);
     }
     else
     {
-        printf("Node: Frequency: %d\n", n->value);
-        print_tree(n->l);
-        print_tree(n->r);
+        printf("Node: Frequency: %" PRIu64 "\n", nodes[n].value);
+        print_tree(nodes, nodes[n].l);
+        print_tree(nodes, nodes[n].r);
     }
 }
 
 /**
- * @brief Builds the Huffman tree from the frequency table.
+ * @brief Builds the Huffman tree from symbol frequencies with the two-queue
+ * method. The leaves are sorted once; merged nodes are created in increasing
+ * order, so the two smallest nodes are always at the front of either queue.
+ * On ties, the leaf is taken first. Linear in the number of symbols after
+ * the sort.
  *
- * @param ft Pointer to the frequency table.
- * @return Pointer to the root of the Huffman tree.
+ * @param freq Frequency of every symbol.
+ * @param nsymbols Number of symbols of the alphabet.
+ * @param nodes Array of at least 2 * nsymbols nodes. It receives the leaves
+ *              of the used symbols, sorted, followed by the internal nodes.
+ * @return Index of the root in nodes, HUFF_NO_NODE if no symbol is used.
  */
-struct node *build_tree(struct frequency_tab *ft, struct leaf *leaves, struct node *nodes, int leaf_count)
+int build_tree(const uint64_t *freq, int nsymbols, struct node *nodes)
 {
+    int leaf_count = 0;
+    for (int i = 0; i < nsymbols; i++)
+    {
+        if (freq[i] > 0)
+        {
+            nodes[leaf_count].l = nodes[leaf_count].r = HUFF_NO_NODE;
+            nodes[leaf_count].symbol = i;
+            nodes[leaf_count].value = freq[i];
+            leaf_count++;
+        }
+    }
+    if (leaf_count == 0)
+    {
+        return HUFF_NO_NODE;
+    }
 
-    int index = 0;
-    for (int i = 0; i < ft->size; i++)
+    // The internal nodes are not built yet, their room is the scratch of the sort
+    sort_leaves(nodes, nodes + leaf_count, leaf_count);
+
+    int leaf = 0;                // Front of the leaf queue
+    int merged = leaf_count;     // Front of the internal node queue
+    int node_count = leaf_count; // End of the internal node queue
+    while (node_count < 2 * leaf_count - 1)
     {
-        if (ft->arr[i] > 0)
+        int pick[2];
+        for (int k = 0; k < 2; k++)
         {
-            leaves[index].c = i;
-            leaves[index].value = ft->arr[i];
-            nodes[index].leaf = &leaves[index];
-            nodes[index].l = nodes[index].r = NULL;
-            nodes[index].value = ft->arr[i];
-            index++;
+            if (merged == node_count || (leaf < leaf_count && nodes[leaf].value <= nodes[merged].value))
+            {
+                pick[k] = leaf++;
+            }
+            else
+            {
+                pick[k] = merged++;
+            }
         }
+
+        nodes[node_count].l = pick[0];
+        nodes[node_count].r = pick[1];
+        nodes[node_count].symbol = -1;
+        nodes[node_count].value = nodes[pick[0]].value + nodes[pick[1]].value;
+        node_count++;
     }
 
-    sort_nodes(nodes, leaf_count);
+    return node_count - 1;
+}
 
-    int node_count = leaf_count;
-    while (node_count > 1)
+/**
+ * @brief Computes the optimal code lengths of at most max_len bits with the
+ * package-merge algorithm. Each level of a list holds the leaves merged with
+ * the packages of pairs of items of the level below, by increasing weight.
+ * The first 2 * count - 2 items of the top level are the coins to pay for:
+ * every time a leaf appears among them, directly or inside a package, its
+ * code gets one bit longer. The items taken at a level are always a prefix of
+ * the leaves and a prefix of the packages, which are made of a prefix of the
+ * level below, so only the package positions of each level are kept.
+ *
+ * @param leaves Leaves sorted by increasing value.
+ * @param count Number of leaves, at least 2 and at most 2^max_len.
+ * @param max_len Maximal code length.
+ * @param lengths Array of HUFF_SYMBOLS code lengths, set for the leaf symbols.
+ */
+static void package_merge(const struct node *leaves, int count, int max_len, uint8_t *lengths)
+{
+    int width = 2 * count;
+    uint64_t *prev = (uint64_t *)malloc(width * sizeof(uint64_t));
+    uint64_t *cur = (uint64_t *)malloc(width * sizeof(uint64_t));
+    uint8_t *is_package = (uint8_t *)malloc((size_t)max_len * width);
+    if (prev == NULL || cur == NULL || is_package == NULL)
     {
-        struct node *left = (struct node *)malloc(sizeof(struct node));
-        struct node *right = (struct node *)malloc(sizeof(struct node));
-        *left = nodes[0];
-        *right = nodes[1];
+        perror("Error allocating package-merge lists");
+        exit(EXIT_FAILURE);
+    }
 
-        struct node new_node = {left, right, NULL, left->value + right->value};
-        for (int i = 0; i < node_count - 2; i++)
+    // The deepest level holds the leaves alone
+    int len = count;
+    for (int i = 0; i < count; i++)
+    {
+        prev[i] = leaves[i].value;
+    }
+    for (int d = max_len - 1; d >= 1; d--)
+    {
+        uint8_t *flags = is_package + (size_t)d * width;
+        int packages = len / 2;
+        int i = 0, p = 0, k = 0;
+        while (i < count || p < packages)
         {
-            nodes[i] = nodes[i + 2];
+            uint64_t weight = (p < packages) ? prev[2 * p] + prev[2 * p + 1] : UINT64_MAX;
+            if (i < count && leaves[i].value <= weight)
+            {
+                cur[k] = leaves[i++].value;
+                flags[k++] = 0;
+            }
+            else
+            {
+                cur[k] = weight;
+                flags[k++] = 1;
+                p++;
+            }
         }
-        nodes[node_count - 2] = new_node;
-        node_count--;
+        len = k;
 
-        sort_nodes(nodes, node_count);
+        uint64_t *swap = prev;
+        prev = cur;
+        cur = swap;
     }
 
-    struct node *tree_root = (struct node *)malloc(sizeof(struct node));
-    *tree_root = nodes[0];
+    int taken = 2 * count - 2;
+    for (int d = 1; d <= max_len && taken > 0; d++)
+    {
+        int packages = 0;
+        if (d < max_len)
+        {
+            const uint8_t *flags = is_package + (size_t)d * width;
+            for (int k = 0; k < taken; k++)
+            {
+                packages += flags[k];
+            }
+        }
+        for (int i = 0; i < taken - packages; i++)
+        {
+            lengths[leaves[i].symbol]++;
+        }
+        taken = 2 * packages;
+    }
 
-    return tree_root;
+    free(prev);
+    free(cur);
+    free(is_package);
 }
 
 /**
- * @brief Generates Huffman codes from the Huffman tree.
+ * @brief Computes the code length of every symbol, which is the depth of its
+ * leaf. Children come before their parent in the flat array, so a single pass
+ * from the root down visits every parent before its children. A lone symbol
+ * still gets a 1-bit code. If the tree is deeper than max_len, the lengths are
+ * computed again with package-merge, which gives the best code under the limit.
  *
- * @param tree Pointer to the root of the Huffman tree.
- * @param code Pointer to the current code.
- * @param depth Current depth in the tree.
- * @param codes Array to store the generated codes.
+ * @param nodes Flat array of the Huffman tree.
+ * @param root Index of the root, HUFF_NO_NODE for an empty tree.
+ * @param max_len Maximal code length, at most HUFF_MAX_CODE_LEN. It is raised
+ *                if it is too short to give every symbol a code.
+ * @param lengths Array of HUFF_SYMBOLS code lengths, 0 for unused symbols.
  */
-void generate_codes(struct node *tree, char *code, int depth, char *codes[])
+void code_lengths(const struct node *nodes, int root, int max_len, uint8_t *lengths)
 {
-    if (tree->leaf != NULL)
+    memset(lengths, 0, HUFF_SYMBOLS);
+    if (root == HUFF_NO_NODE)
     {
-        code[depth] = '\0';
-        codes[(unsigned char)tree->leaf->c] = strdup(code);
         return;
     }
+    if (nodes[root].l == HUFF_NO_NODE)
+    {
+        lengths[nodes[root].symbol] = 1;
+        return;
+    }
+
+    int *depth = (int *)calloc(root + 1, sizeof(int));
+    if (depth == NULL)
+    {
+        perror("Error allocating code lengths");
+        exit(EXIT_FAILURE);
+    }
+    int deepest = 0;
+    for (int n = root; n >= 0; n--)
+    {
+        if (nodes[n].l == HUFF_NO_NODE)
+        {
+            lengths[nodes[n].symbol] = depth[n];
+            if (depth[n] > deepest)
+            {
+                deepest = depth[n];
+            }
+        }
+        else
+        {
+            depth[nodes[n].l] = depth[nodes[n].r] = depth[n] + 1;
+        }
+    }
+    free(depth);
+
+    // The sorted leaves are the first half of the flat tree
+    int leaf_count = root / 2 + 1;
+    int min_len = 1;
+    while ((1 << min_len) < leaf_count)
+    {
+        min_len++;
+    }
+    if (max_len > HUFF_MAX_CODE_LEN)
+    {
+        max_len = HUFF_MAX_CODE_LEN;
+    }
+    if (max_len < min_len)
+    {
+        max_len = min_len;
+    }
 
-    if (tree->l != NULL)
+    if (deepest > max_len)
     {
-        code[depth] = '0';
-        generate_codes(tree->l, code, depth + 1, codes);
+        DEBUG_PRINT("[DEBUG] (HUFFMAN) Codes of %d bits limited to %d bits\n", deepest, max_len);
+        memset(lengths, 0, HUFF_SYMBOLS);
+        package_merge(nodes, leaf_count, max_len, lengths);
     }
+}
 
-    if (tree->r != NULL)
+/**
+ * @brief Generates the canonical Huffman codes of the given lengths. Codes of
+ * a same length are consecutive integers in symbol order, and each length
+ * starts right after the last code of the previous one, shifted left. The
+ * decoder rebuilds the very same codes from the lengths alone.
+ *
+ * @param lengths Array of HUFF_SYMBOLS code lengths, 0 for unused symbols.
+ * @param codes Array of HUFF_SYMBOLS codes to fill, right-aligned on their
+ *              length; 0 for unused symbols.
+ */
+void generate_codes(const uint8_t *lengths, uint32_t *codes)
+{
+    int count[HUFF_MAX_CODE_LEN + 1] = {0};
+    for (int s = 0; s < HUFF_SYMBOLS; s++)
     {
-        code[depth] = '1';
-        generate_codes(tree->r, code, depth + 1, codes);
+        count[lengths[s]]++;
+    }
+    count[0] = 0;
+
+    // Past the longest length in use, the next code may need 33 bits
+    uint64_t next[HUFF_MAX_CODE_LEN + 1];
+    uint64_t code = 0;
+    for (int len = 1; len <= HUFF_MAX_CODE_LEN; len++)
+    {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+
+    for (int s = 0; s < HUFF_SYMBOLS; s++)
+    {
+        codes[s] = (lengths[s] != 0) ? (uint32_t)next[lengths[s]]++ : 0;
     }
 }
 
 /**
- * @brief Converts a character to its binary representation and writes it to a binary file.
+ * @brief Writes a positive integer with the Elias gamma code: as many 0 as
+ * the number of bits of value after its leading 1, then value itself.
  *
- * @param c Character to convert.
+ * @param value Integer to write, at least 1.
  * @param output Pointer to the binary file.
  */
-void char_to_binary(char c, BFILE *output)
+static void write_gamma(unsigned int value, BFILE *output)
 {
-    for (int i = 7; i >= 0; i--)
+    int nbits = 32 - __builtin_clz(value);
+    bputbits_fast(value, 2 * nbits - 1, output);
+}
+
+/**
+ * @brief Writes an unsigned integer as a varint: 7 bits per byte, the weakest
+ * first, the top bit set on all the bytes but the last.
+ *
+ * @param value Integer to write.
+ * @param output Pointer to the binary file.
+ */
+static void write_varint(uint64_t value, BFILE *output)
+{
+    while (value >= 0x80)
     {
-        unsigned char bit = (c & (1 << i)) ? 1 : 0;
-        bputbit(bit, output);
+        bputbits_fast((value & 0x7F) | 0x80, 8, output);
+        value >>= 7;
     }
+    bputbits_fast(value, 8, output);
 }
 
 /**
- * @brief Writes the Huffman tree to a binary file.
+ * @brief Writes the code lengths, which is all the decoder needs to rebuild
+ * the codes. The number of used symbols comes first, then for each of them,
+ * in symbol order, the number of unused symbols skipped since the previous
+ * one and the difference with the previous length. All are small integers,
+ * written with the gamma code (signed differences zigzag-mapped).
  *
- * @param tree Pointer to the root of the Huffman tree.
+ * @param lengths Array of HUFF_SYMBOLS code lengths, 0 for unused symbols.
  * @param output Pointer to the binary file.
  */
-void write_dictionary(struct node *tree, BFILE *output)
+void write_lengths(const uint8_t *lengths, BFILE *output)
 {
-    if (tree->leaf != NULL)
+    int used = 0;
+    for (int s = 0; s < HUFF_SYMBOLS; s++)
     {
-        bputbit(1, output);
-        char_to_binary(tree->leaf->c, output);
+        used += lengths[s] != 0;
     }
-    else
+    write_gamma(used + 1, output);
+
+    int prev_symbol = -1;
+    int prev_len = 0;
+    for (int s = 0; s < HUFF_SYMBOLS; s++)
     {
-        bputbit(0, output);
-        write_dictionary(tree->l, output);
-        write_dictionary(tree->r, output);
+        if (lengths[s] == 0)
+        {
+            continue;
+        }
+        int delta = lengths[s] - prev_len;
+        write_gamma(s - prev_symbol, output);
+        write_gamma((delta > 0) ? 2 * delta : 1 - 2 * delta, output);
+        prev_symbol = s;
+        prev_len = lengths[s];
     }
 }
 
 /**
- * @brief Encodes a file using Huffman coding.
+ * @brief Writes the code lengths and the encoded bytes of a buffer.
  *
- * @param input_file Path to the input file.
- * @param output_file Path to the output file.
- * @param tree Pointer to the root of the Huffman tree.
- * @param codes Array of Huffman codes.
+ * @param data Location of the bytes to encode.
+ * @param size Number of bytes.
+ * @param lengths Array of HUFF_SYMBOLS code lengths.
+ * @param codes Array of HUFF_SYMBOLS Huffman codes.
+ * @param output Pointer to the binary file.
  */
-void encode_file(const char *input_file, const char *output_file, struct node *tree, char *codes[])
+void encode_buffer(const uint8_t *data, size_t size, const uint8_t *lengths, const uint32_t *codes, BFILE *output)
 {
-    FILE *input = fopen(input_file, "rb");
-    BFILE *output = bopen(output_file, 'w', 0); // Disable automatic padding
+    // Write code lengths to output file
+    write_lengths(lengths, output);
 
-    if (input == NULL || output == NULL)
+    // Encode the bytes, one accumulator operation per symbol
+    for (size_t i = 0; i < size; i++)
     {
-        perror("Error opening files");
-        return;
+        bputbits_fast(codes[data[i]], lengths[data[i]], output);
     }
+}
 
-    // Write dictionary to output file
-    write_dictionary(tree, output);
+/**
+ * @brief Encodes a buffer using Huffman coding, with codes of at most max_len
+ * bits. The histogram and the encoding both read the same buffer.
+ *
+ * @param data Location of the bytes to encode.
+ * @param size Number of bytes.
+ * @param output Binary stream just opened for writing with padding, to a file
+ *               or to memory. It is left open.
+ * @param max_len Maximal code length, between 1 and HUFF_MAX_CODE_LEN.
+ * @return 0 upon success, otherwise -1.
+ */
+int huff_encode_buffer(const uint8_t *data, size_t size, BFILE *output, int max_len)
+{
+    struct frequency_tab ft;
+    init_frequency_tab(&ft);
+    update_frequency_buffer(&ft, data, size);
+    // print_frequency_tab(&ft);
 
-    // Encode file content
-    int chr;
-    int bits_written = 0; // Track the number of bits written
-    while ((chr = fgetc(input)) != EOF)
+    struct node *nodes = (struct node *)malloc(2 * ft.size * sizeof(struct node));
+    if (nodes == NULL)
     {
-        char *code = codes[chr];
-        for (int i = 0; code[i] != '\0'; i++)
-        {
-            unsigned char bit = code[i] - '0';
-            bputbit(bit, output);
-            bits_written++;
-        }
+        perror("Error allocating the Huffman tree");
+        return -1;
     }
 
-    // Calculate the number of padding bits needed
-    int padding_bits = (8 - (bits_written % 8)) % 8;
+    // An empty input has no code at all
+    int root = build_tree(ft.arr, ft.size, nodes);
+    // print_tree(nodes, root);
+
+    uint8_t lengths[HUFF_SYMBOLS];
+    code_lengths(nodes, root, max_len, lengths);
+    free(nodes);
+
+    uint32_t codes[HUFF_SYMBOLS];
+    generate_codes(lengths, codes);
 
-    // Write the padding bits (1 followed by 0s)
-    bputbit(1, output);
-    for (int i = 0; i < padding_bits - 1; i++)
+    if (bchecksum(output) != 0) // Lets the decoder detect corrupted files
     {
-        bputbit(0, output);
+        return -1;
     }
-
-    bclose(output);
-    fclose(input);
+    // The decoder knows the size of the message before its first code
+    write_varint(size, output);
+    encode_buffer(data, size, lengths, codes, output);
+    return 0;
 }
 
 /**
- * @brief Frees memory allocated for the Huffman tree.
+ * @brief Loads a whole input file in memory. Regular files are mapped, so the
+ * bytes are read once from the page cache; other files (pipes, terminals)
+ * are read in a growing buffer.
  *
- * @param tree Pointer to the root of the Huffman tree.
+ * @param path Path to the file.
+ * @param size Location where the number of bytes is stored.
+ * @param mapped Location where 1 is stored if the file is mapped, 0 otherwise.
+ * @return The location of the bytes, to release with unload_input(), or NULL.
  */
-void free_tree(struct node *tree)
+static uint8_t *load_input(const char *path, size_t *size, int *mapped)
 {
-    if (tree == NULL)
-        return;
-    free_tree(tree->l);
-    free_tree(tree->r);
-    free(tree);
-}
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
 
-void huff_encode(char *input_file, char *output_file)
-{
-    struct frequency_tab ft;
-    init_frequency_tab(&ft);
-    update_frequency_tab(&ft, input_file);
-    // print_frequency_tab(&ft);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            *size = (size_t)st.st_size;
+            *mapped = 1;
+            return (uint8_t *)map;
+        }
+    }
 
-    int leaf_count = 0;
-    for (int i = 0; i < ft.size; i++)
+    size_t cap = 65536;
+    size_t len = 0;
+    uint8_t *data = (uint8_t *)malloc(cap);
+    while (data != NULL)
     {
-        if (ft.arr[i] > 0)
+        ssize_t n = read(fd, data + len, cap - len);
+        if (n == 0)
         {
-            leaf_count++;
+            break;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // A partial input must not be encoded as if it were whole
+            free(data);
+            data = NULL;
+            break;
+        }
+        len += (size_t)n;
+        if (len == cap)
+        {
+            cap *= 2;
+            uint8_t *bigger = (uint8_t *)realloc(data, cap);
+            if (bigger == NULL)
+            {
+                free(data);
+            }
+            data = bigger;
         }
     }
+    close(fd);
 
-    struct leaf *leaves = (struct leaf *)malloc(leaf_count * sizeof(struct leaf));
-    struct node *nodes = (struct node *)malloc(leaf_count * sizeof(struct node));
+    *size = len;
+    *mapped = 0;
+    return data;
+}
 
-    struct node *tree = build_tree(&ft, leaves, nodes, leaf_count);
-    // print_tree(tree);
+/**
+ * @brief Releases an input loaded by load_input().
+ *
+ * @param data Location of the bytes.
+ * @param size Number of bytes.
+ * @param mapped 1 if the input is mapped, 0 otherwise.
+ */
+static void unload_input(uint8_t *data, size_t size, int mapped)
+{
+    if (mapped)
+    {
+        munmap(data, size);
+    }
+    else
+    {
+        free(data);
+    }
+}
 
-    char *codes[256] = {0};
-    char code[256];
-    generate_codes(tree, code, 0, codes);
+/**
+ * @brief Encodes a file using Huffman coding, with codes of at most max_len bits.
+ * The input is read only once.
+ *
+ * @param input_file Path to the input file.
+ * @param output_file Path to the output file.
+ * @param max_len Maximal code length, between 1 and HUFF_MAX_CODE_LEN.
+ */
+void huff_encode_limit(char *input_file, char *output_file, int max_len)
+{
+    size_t size;
+    int mapped;
+    uint8_t *data = load_input(input_file, &size, &mapped);
+    if (data == NULL)
+    {
+        perror("Error opening input file");
+        return;
+    }
 
-    encode_file(input_file, output_file, tree, codes);
+    // The padding tells the decoder where the last code ends
+    BFILE *output = bopen(output_file, 'w', 1);
+    if (output == NULL)
+    {
+        perror("Error opening output file");
+        unload_input(data, size, mapped);
+        return;
+    }
 
-    // Free allocated memory
-    free_tree(tree);
-    for (int i = 0; i < 256; i++)
+    // The stream is closed even if encoding fails
+    int ret = huff_encode_buffer(data, size, output, max_len);
+    if (bclose(output) != 0 || ret != 0)
     {
-        if (codes[i])
-        {
-            free(codes[i]);
-        }
+        fprintf(stderr, "Error writing %s\n", output_file);
     }
-    free(leaves);
-    free(nodes);
+    unload_input(data, size, mapped);
+}
+
+/**
+ * @brief Encodes a file using Huffman coding.
+ *
+ * @param input_file Path to the input file.
+ * @param output_file Path to the output file.
+ */
+void huff_encode(char *input_file, char *output_file)
+{
+    huff_encode_limit(input_file, output_file, HUFF_MAX_CODE_LEN);
 }
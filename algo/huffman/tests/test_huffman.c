@@ -25,7 +25,10 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
 #include "huffman_enc.h"
 #include "huffman_dec.h"
 
@@ -48,6 +51,37 @@ void test_frequency_tab()
     printf("Frequency tab test passed!\n\n");
 }
 
+void test_byte_histogram()
+{
+    printf("Testing byte_histogram function:\n");
+
+    // Large enough to be split between threads, with a tail shorter than a word
+    size_t size = (9 << 20) + 5;
+    uint8_t *data = (uint8_t *)malloc(size);
+    assert(data != NULL);
+    uint64_t expected[256] = {0};
+    unsigned int seed = 7;
+    for (size_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        // Long runs of one byte, then random bytes
+        data[i] = (i < size / 2) ? 'a' : (seed >> 16) & 0xFF;
+        expected[data[i]]++;
+    }
+
+    uint64_t counts[256];
+    byte_histogram(data, size, counts);
+    assert(memcmp(counts, expected, sizeof(counts)) == 0);
+
+    byte_histogram(data + 1, 6, counts);
+    assert(counts['a'] == 6);
+    byte_histogram(data, 0, counts);
+    assert(counts['a'] == 0);
+
+    free(data);
+    printf("byte_histogram test passed!\n\n");
+}
+
 void test_build_tree()
 {
     printf("Testing build tree function:\n");
@@ -56,28 +90,230 @@ void test_build_tree()
     init_frequency_tab(&ft);
     update_frequency_tab(&ft, "tests/input");
 
-    int leaf_count = 0;
-    for (int i = 0; i < ft.size; i++)
+    struct node *nodes = (struct node *)malloc(2 * ft.size * sizeof(struct node));
+
+    int root = build_tree(ft.arr, ft.size, nodes);
+
+    // Traverse the tree and verify structure
+    struct node *tree = &nodes[root];
+    assert(tree->value == 7);
+    assert(nodes[tree->l].value == 3);
+    assert(nodes[tree->l].symbol == 'a');
+    assert(nodes[tree->r].value == 4);
+    assert(nodes[nodes[tree->r].l].value == 2);
+    assert(nodes[nodes[tree->r].r].value == 2);
+
+    // No symbol, then a single one
+    uint64_t freq[300] = {0};
+    assert(build_tree(freq, 300, nodes) == HUFF_NO_NODE);
+    freq[299] = 5;
+    root = build_tree(freq, 300, nodes);
+    assert(nodes[root].l == HUFF_NO_NODE && nodes[root].symbol == 299);
+
+    // Counts past 32 bits, as in multi-gigabyte inputs
+    freq[299] = 0;
+    freq[1] = 5000000000ULL;
+    freq[2] = 4294967296ULL;
+    freq[3] = 4294967295ULL;
+    root = build_tree(freq, 300, nodes);
+    assert(nodes[root].value == 13589934591ULL);
+    assert(nodes[0].symbol == 3 && nodes[1].symbol == 2 && nodes[2].symbol == 1);
+    assert(nodes[nodes[root].l].symbol == 1);
+    free(nodes);
+
+    // Large alphabet: the root holds the total and no node is lighter than its children
+    int nsymbols = 65536;
+    uint64_t *big = (uint64_t *)malloc(nsymbols * sizeof(uint64_t));
+    nodes = (struct node *)malloc(2 * nsymbols * sizeof(struct node));
+    uint64_t total = 0;
+    unsigned int seed = 1;
+    for (int i = 0; i < nsymbols; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        big[i] = (seed >> 16) % 1000;
+        total += big[i];
+    }
+    root = build_tree(big, nsymbols, nodes);
+    assert(nodes[root].value == total);
+    int leaves = 0;
+    for (int n = 0; n <= root; n++)
     {
-        if (ft.arr[i] > 0)
+        if (nodes[n].l == HUFF_NO_NODE)
         {
-            leaf_count++;
+            assert(big[nodes[n].symbol] == nodes[n].value);
+            leaves++;
+        }
+        else
+        {
+            assert(nodes[n].value == nodes[nodes[n].l].value + nodes[nodes[n].r].value);
+            // Merged nodes come in increasing order
+            assert(nodes[n - 1].l == HUFF_NO_NODE || nodes[n].value >= nodes[n - 1].value);
         }
     }
+    assert(root == 2 * leaves - 2);
+    free(big);
+    free(nodes);
 
-    struct leaf *leaves = (struct leaf *)malloc(leaf_count * sizeof(struct leaf));
-    struct node *nodes = (struct node *)malloc(leaf_count * sizeof(struct node));
+    printf("Build tree test passed!\n\n");
+}
 
-    struct node *tree = build_tree(&ft, leaves, nodes, leaf_count);
+void test_canonical_codes()
+{
+    printf("Testing canonical codes functions:\n");
 
-    // Traverse the tree and verify structure
-    assert(tree->value == 7);
-    assert(tree->l->value == 3);
-    assert(tree->r->value == 4);
-    assert(tree->r->l->value == 2);
-    assert(tree->r->r->value == 2);
+    struct frequency_tab ft;
+    init_frequency_tab(&ft);
+    update_frequency_tab(&ft, "tests/input");
+    struct node *nodes = (struct node *)malloc(2 * ft.size * sizeof(struct node));
+    int root = build_tree(ft.arr, ft.size, nodes);
 
-    printf("Build tree test passed!\n\n");
+    uint8_t lengths[HUFF_SYMBOLS];
+    code_lengths(nodes, root, HUFF_MAX_CODE_LEN, lengths);
+    assert(lengths['a'] == 1 && lengths['c'] == 2 && lengths['b'] == 3 && lengths['d'] == 3);
+    assert(lengths['e'] == 0);
+
+    // Shorter codes first, then symbol order
+    uint32_t codes[HUFF_SYMBOLS];
+    generate_codes(lengths, codes);
+    assert(codes['a'] == 0x0); // 0
+    assert(codes['c'] == 0x2); // 10
+    assert(codes['b'] == 0x6); // 110
+    assert(codes['d'] == 0x7); // 111
+    assert(codes['e'] == 0);
+
+    // Lengths go through the header and give back the codes
+    uchar *buf = NULL;
+    size_t size = 0;
+    BFILE *bfile = bopen_membuf(&buf, &size, 1);
+    write_lengths(lengths, bfile);
+    bputbits(0x6, 3, bfile); // "110"
+    bputbits(0x0, 1, bfile); // "0"
+    bclose(bfile);
+
+    uint8_t read[HUFF_SYMBOLS];
+    struct huff_decoder dec;
+    bfile = bopen_mem(buf, size, 1);
+    assert(read_lengths(bfile, read) == 4);
+    assert(memcmp(read, lengths, HUFF_SYMBOLS) == 0);
+    assert(build_decoder(read, &dec) == 0);
+    // Every first-level index starting with a code holds its symbol
+    assert(dec.table[0].value == 'a' && dec.table[0].len == 1);
+    assert(dec.table[(1 << HUFF_TABLE_BITS) - 1].value == 'd' && dec.table[(1 << HUFF_TABLE_BITS) - 1].len == 3);
+    build_multi(&dec);
+    // "110" then zeros: 'b' and as many 'a' as an entry holds
+    struct huff_multi *multi = &dec.multi[0x6 << (HUFF_MULTI_BITS - 3)];
+    assert(multi->count == HUFF_MULTI_SYMBOLS && multi->bits == 3 + HUFF_MULTI_SYMBOLS - 1);
+    assert(multi->symbol[0] == 'b' && multi->symbol[1] == 'a');
+    // "111111111111": only whole codes
+    multi = &dec.multi[(1 << HUFF_MULTI_BITS) - 1];
+    assert(multi->count == HUFF_MULTI_BITS / 3 && multi->symbol[0] == 'd');
+    assert(decode_symbol(&dec, bfile) == 'b');
+    assert(decode_symbol(&dec, bfile) == 'a');
+    assert(decode_symbol(&dec, bfile) == EOF);
+    bclose(bfile);
+    free(buf);
+
+    // Codes longer than half an index never share one
+    uint8_t flat[HUFF_SYMBOLS];
+    memset(flat, 8, HUFF_SYMBOLS);
+    assert(build_decoder(flat, &dec) == 0);
+    build_multi(&dec);
+    assert(!dec.multi_ready);
+
+    // Too many short codes do not form a prefix code
+    memset(read, 0, HUFF_SYMBOLS);
+    read['x'] = read['y'] = read['z'] = 1;
+    assert(build_decoder(read, &dec) != 0);
+    // Nor do codes leaving some bit strings unused, a lone symbol excepted
+    read['z'] = 0;
+    read['y'] = 2;
+    assert(build_decoder(read, &dec) != 0);
+    read['y'] = 0;
+    assert(build_decoder(read, &dec) == 0);
+
+    free(nodes);
+    printf("Canonical codes test passed!\n\n");
+}
+
+void test_length_limit()
+{
+    printf("Testing length-limited codes:\n");
+
+    uint64_t freq[HUFF_SYMBOLS] = {0};
+    struct node *nodes = (struct node *)malloc(2 * HUFF_SYMBOLS * sizeof(struct node));
+    uint8_t lengths[HUFF_SYMBOLS];
+
+    // Depths 4 4 3 2 1 limited to 3: the best code is 3 3 3 3 1
+    freq['a'] = 1;
+    freq['b'] = 1;
+    freq['c'] = 2;
+    freq['d'] = 4;
+    freq['e'] = 8;
+    int root = build_tree(freq, HUFF_SYMBOLS, nodes);
+    code_lengths(nodes, root, HUFF_MAX_CODE_LEN, lengths);
+    assert(lengths['a'] == 4 && lengths['e'] == 1);
+    code_lengths(nodes, root, 3, lengths);
+    assert(lengths['a'] == 3 && lengths['b'] == 3 && lengths['c'] == 3 && lengths['d'] == 3);
+    assert(lengths['e'] == 1);
+
+    // Fibonacci counts give a 39-bit deep tree, limited to 11 and 12 bits
+    memset(freq, 0, sizeof(freq));
+    uint64_t fib[2] = {1, 1};
+    for (int i = 0; i < 40; i++)
+    {
+        freq[i] = fib[i % 2];
+        fib[i % 2] += fib[(i + 1) % 2];
+    }
+    root = build_tree(freq, HUFF_SYMBOLS, nodes);
+    int limits[] = {11, 12, HUFF_MAX_CODE_LEN, 2};
+    for (int k = 0; k < 4; k++)
+    {
+        code_lengths(nodes, root, limits[k], lengths);
+        // A complete prefix code within the limit; 40 symbols need 6 bits at least
+        int max_len = limits[k] < 6 ? 6 : limits[k];
+        uint64_t kraft = 0;
+        for (int s = 0; s < HUFF_SYMBOLS; s++)
+        {
+            assert(lengths[s] <= max_len);
+            assert((lengths[s] != 0) == (freq[s] != 0));
+            if (lengths[s] != 0)
+            {
+                kraft += 1ULL << (HUFF_MAX_CODE_LEN - lengths[s]);
+            }
+        }
+        assert(kraft == 1ULL << HUFF_MAX_CODE_LEN);
+    }
+
+    struct huff_decoder dec;
+    code_lengths(nodes, root, 11, lengths);
+    assert(build_decoder(lengths, &dec) == 0 && dec.max_len == 11);
+
+    free(nodes);
+    printf("Length-limited codes test passed!\n\n");
+}
+
+// Encodes and decodes a file, which must come back identical
+static void check_round_trip(const char *input_file, int max_len)
+{
+    char *encoded_file = "tests/round_trip_encoded";
+    char *decoded_file = "tests/round_trip_decoded";
+    huff_encode_limit((char *)input_file, encoded_file, max_len);
+    huff_decode(encoded_file, decoded_file);
+
+    FILE *input = fopen(input_file, "rb");
+    FILE *decoded = fopen(decoded_file, "rb");
+    assert(input != NULL && decoded != NULL);
+    int ch1, ch2;
+    do
+    {
+        ch1 = fgetc(input);
+        ch2 = fgetc(decoded);
+        assert(ch1 == ch2);
+    } while (ch1 != EOF);
+    fclose(input);
+    fclose(decoded);
+    remove(encoded_file);
+    remove(decoded_file);
 }
 
 void test_encode_decode()
@@ -107,15 +343,231 @@ void test_encode_decode()
     fclose(input);
     fclose(decoded);
 
+    // Empty, single-symbol and skewed inputs, and all the byte values
+    char *other_file = "tests/sample_input";
+    FILE *f = fopen(other_file, "wb");
+    fclose(f);
+    check_round_trip(other_file, HUFF_MAX_CODE_LEN);
+
+    f = fopen(other_file, "wb");
+    for (int i = 0; i < 1000; i++)
+    {
+        fputc('z', f);
+    }
+    fclose(f);
+    check_round_trip(other_file, HUFF_MAX_CODE_LEN);
+
+    f = fopen(other_file, "wb");
+    unsigned int seed = 3;
+    for (int i = 0; i < 100000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        fputc((seed >> 16) % 7 == 0 ? (seed >> 8) & 0xFF : 'e', f);
+    }
+    fclose(f);
+    check_round_trip(other_file, HUFF_MAX_CODE_LEN);
+    check_round_trip(other_file, 9);
+
+    f = fopen(other_file, "wb");
+    for (int i = 0; i < 256 * 10; i++)
+    {
+        fputc(i % 256, f);
+    }
+    fclose(f);
+    check_round_trip(other_file, HUFF_MAX_CODE_LEN);
+
+    // Fibonacci counts give codes too long for the decoding tables
+    f = fopen(other_file, "wb");
+    int fib[2] = {1, 1};
+    for (int i = 0; i < 26; i++)
+    {
+        for (int k = 0; k < fib[i % 2]; k++)
+        {
+            fputc('A' + i, f);
+        }
+        fib[i % 2] += fib[(i + 1) % 2];
+    }
+    fclose(f);
+    check_round_trip(other_file, HUFF_MAX_CODE_LEN);
+    check_round_trip(other_file, HUFF_TABLE_BITS + 2);
+    remove(other_file);
+
     printf("Encode and decode test passed!\n\n");
 }
 
+// Encodes bytes from memory, which must give the same stream as huff_encode()
+static void check_buffer(const uint8_t *data, size_t size)
+{
+    char *input_file = "tests/sample_input";
+    char *encoded_file = "tests/buffer_encoded";
+    FILE *f = fopen(input_file, "wb");
+    assert(f != NULL && fwrite(data, 1, size, f) == size);
+    fclose(f);
+    huff_encode(input_file, encoded_file);
+    remove(input_file);
+
+    uchar *buf = NULL;
+    size_t buf_size = 0;
+    BFILE *output = bopen_membuf(&buf, &buf_size, 1);
+    assert(output != NULL);
+    assert(huff_encode_buffer(data, size, output, HUFF_MAX_CODE_LEN) == 0);
+    assert(bclose(output) == 0);
+
+    f = fopen(encoded_file, "rb");
+    assert(f != NULL);
+    for (size_t i = 0; i < buf_size; i++)
+    {
+        assert(fgetc(f) == buf[i]);
+    }
+    assert(fgetc(f) == EOF);
+    fclose(f);
+    remove(encoded_file);
+    free(buf);
+}
+
+void test_encode_buffer()
+{
+    printf("Testing huff_encode_buffer function:\n");
+
+    check_buffer(NULL, 0);
+    check_buffer((const uint8_t *)"zzzz", 4);
+
+    FILE *f = fopen("tests/input", "rb");
+    assert(f != NULL);
+    uint8_t data[65536];
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    check_buffer(data, size);
+
+    printf("huff_encode_buffer test passed!\n\n");
+}
+
+void test_decode_stream()
+{
+    printf("Testing huff_decode_stream function:\n");
+
+    char *input_file = "tests/input";
+    char *encoded_file = "tests/stream_encoded";
+    huff_encode(input_file, encoded_file);
+
+    uint8_t encoded[4096];
+    FILE *f = fopen(encoded_file, "rb");
+    assert(f != NULL);
+    size_t size = fread(encoded, 1, sizeof(encoded), f);
+    fclose(f);
+    remove(encoded_file);
+
+    // From a pipe, which can not be seeked nor mapped
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], encoded, size) == (ssize_t)size);
+    close(fds[1]);
+    FILE *output = tmpfile();
+    assert(output != NULL);
+    assert(huff_decode_stream(bopen_fd(fds[0], 'r', 1), output) == 0);
+
+    rewind(output);
+    f = fopen(input_file, "rb");
+    assert(f != NULL);
+    int ch;
+    while ((ch = fgetc(f)) != EOF)
+    {
+        assert(fgetc(output) == ch);
+    }
+    assert(fgetc(output) == EOF);
+    fclose(f);
+    fclose(output);
+
+    // A stream whose first bits are already buffered can not be checked
+    BFILE *bfile = bopen_mem(encoded, size, 1);
+    bpeek(bfile, 8);
+    output = tmpfile();
+    assert(huff_decode_stream(bfile, output) != 0);
+    fclose(output);
+
+    // A flipped bit is reported
+    encoded[size / 2] ^= 0x10;
+    output = tmpfile();
+    assert(huff_decode_stream(bopen_mem(encoded, size, 1), output) != 0);
+    fclose(output);
+
+    printf("huff_decode_stream test passed!\n\n");
+}
+
+void test_message_size()
+{
+    printf("Testing the message size in the header:\n");
+
+    // Known without decoding
+    char *encoded_file = "tests/size_encoded";
+    huff_encode("tests/input", encoded_file);
+    FILE *f = fopen("tests/input", "rb");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    uint64_t size = 0;
+    assert(huff_decoded_size(encoded_file, &size) == 0 && size == (uint64_t)ftell(f));
+    fclose(f);
+    remove(encoded_file);
+
+    // Varint of 3 bytes, then the codes
+    size_t data_size = 100000;
+    uint8_t *data = (uint8_t *)malloc(data_size);
+    assert(data != NULL);
+    for (size_t i = 0; i < data_size; i++)
+    {
+        data[i] = "abracadabra"[i % 11];
+    }
+    uchar *buf = NULL;
+    size_t buf_size = 0;
+    BFILE *bfile = bopen_membuf(&buf, &buf_size, 1);
+    assert(huff_encode_buffer(data, data_size, bfile, HUFF_MAX_CODE_LEN) == 0);
+    assert(bclose(bfile) == 0);
+    assert(buf[0] == (0x80 | (100000 & 0x7F)) && buf[2] == (100000 >> 14));
+
+    struct huff_decoder dec;
+    uint8_t *out = (uint8_t *)malloc(data_size);
+    assert(out != NULL);
+    bfile = bopen_mem(buf, buf_size, 1);
+    bchecksum(bfile);
+    assert(read_header(bfile, &size, &dec) == 0 && size == data_size);
+    build_multi(&dec);
+    assert(decode_buffer(&dec, bfile, out, data_size) == 0);
+    assert(memcmp(out, data, data_size) == 0);
+    assert(bclose(bfile) == 0);
+
+    // A wrong size leaves codes unread or runs out of them
+    int sizes[] = {-1, 1};
+    for (int k = 0; k < 2; k++)
+    {
+        buf[0] += sizes[k];
+        bfile = bopen_mem(buf, buf_size, 1);
+        bchecksum(bfile);
+        assert(read_header(bfile, &size, &dec) == 0 && size == data_size + sizes[k]);
+        FILE *output = tmpfile();
+        assert(decode_message(&dec, bfile, size, output) != 0);
+        fclose(output);
+        bclose(bfile);
+        buf[0] -= sizes[k];
+    }
+
+    free(out);
+    free(buf);
+    free(data);
+    printf("Message size test passed!\n\n");
+}
+
 int main()
 {
     test_frequency_tab();
+    test_byte_histogram();
     test_build_tree();
+    test_canonical_codes();
+    test_length_limit();
 
     test_encode_decode();
+    test_encode_buffer();
+    test_decode_stream();
+    test_message_size();
 
     printf("All unit tests passed!\n");
 